@@ -449,6 +449,61 @@ wl_cursor_theme_get_cursor(struct wl_cursor_theme *theme,
 	return NULL;
 }
 
+/** Create the shm buffers of a cursor ahead of time
+ *
+ * \param cursor The cursor
+ * \param image_count How many images, starting from the first one, to
+ * create buffers for, or 0 for all of them
+ * \return The number of images that have a buffer afterwards, or -1 if
+ * creating a buffer failed
+ *
+ * Buffers are otherwise created by wl_cursor_image_get_buffer() the
+ * first time an image is shown, so the first cycle of an animated cursor
+ * sends requests while it plays. Creating them up front sends all those
+ * requests in one go instead, at the cost of the compositor keeping a
+ * wl_buffer per image around. Passing a small \a image_count limits that
+ * to the start of the animation.
+ *
+ * \sa wl_cursor_theme_prepare_buffers()
+ */
+WL_EXPORT int
+wl_cursor_prepare_buffers(struct wl_cursor *cursor, unsigned int image_count)
+{
+	unsigned int i;
+
+	if (image_count == 0 || image_count > cursor->image_count)
+		image_count = cursor->image_count;
+
+	for (i = 0; i < image_count; i++)
+		if (!wl_cursor_image_get_buffer(cursor->images[i]))
+			return -1;
+
+	return image_count;
+}
+
+/** Create the shm buffers of all cursors of a theme ahead of time
+ *
+ * \param theme The cursor theme
+ * \param image_count How many images of each cursor to create buffers
+ * for, or 0 for all of them
+ * \return 0 on success, or -1 if creating a buffer failed
+ *
+ * Calls wl_cursor_prepare_buffers() on every cursor of the theme.
+ */
+WL_EXPORT int
+wl_cursor_theme_prepare_buffers(struct wl_cursor_theme *theme,
+				unsigned int image_count)
+{
+	unsigned int i;
+
+	for (i = 0; i < theme->cursor_count; i++)
+		if (wl_cursor_prepare_buffers(theme->cursors[i],
+					      image_count) < 0)
+			return -1;
+
+	return 0;
+}
+
 /** Find the frame for a given elapsed time in a cursor animation
  *  as well as the time left until next cursor change.
  *
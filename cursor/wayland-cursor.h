@@ -82,6 +82,13 @@ wl_cursor_theme_get_cursor(struct wl_cursor_theme *theme,
 struct wl_buffer *
 wl_cursor_image_get_buffer(struct wl_cursor_image *image);
 
+int
+wl_cursor_prepare_buffers(struct wl_cursor *cursor, unsigned int image_count);
+
+int
+wl_cursor_theme_prepare_buffers(struct wl_cursor_theme *theme,
+				unsigned int image_count);
+
 int
 wl_cursor_frame(struct wl_cursor *cursor, uint32_t time);
 
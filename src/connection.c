@@ -26,7 +26,11 @@
 
 #define _GNU_SOURCE
 
+#include "../config.h"
+
 #include <math.h>
+#include <limits.h>
+#include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -37,6 +41,11 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
 #include <time.h>
 #include <ffi.h>
 
@@ -54,12 +63,19 @@ div_roundup(uint32_t n, size_t a)
 	return (uint32_t) (((uint64_t) n + (a - 1)) / a);
 }
 
+#define RING_BUFFER_SIZE WL_CONNECTION_BUFFER_SIZE
+
+/* A mirrored ring buffer has its storage mapped twice back to back, so
+ * that any RING_BUFFER_SIZE bytes starting at a masked index are
+ * contiguous in memory and no access ever has to wrap around. */
 struct wl_ring_buffer {
-	char data[4096];
+	char *data;
 	uint32_t head, tail;
+	bool mirrored;
+	char storage[RING_BUFFER_SIZE];
 };
 
-#define MASK(i) ((i) & 4095)
+#define MASK(i) ((i) & (RING_BUFFER_SIZE - 1))
 
 #define MAX_FDS_OUT	28
 #define CLEN		(CMSG_LEN(MAX_FDS_OUT * sizeof(int32_t)))
@@ -69,25 +85,56 @@ struct wl_connection {
 	struct wl_ring_buffer fds_in, fds_out;
 	int fd;
 	int want_flush;
+
+	/* Outgoing messages and fds that did not fit in the out buffers
+	 * while the socket was full; see wl_connection_set_max_overflow().
+	 * The queues start at the head offsets, drained data before them
+	 * is only compacted away once it is half of the array. */
+	struct wl_array overflow;
+	struct wl_array overflow_fds;
+	size_t overflow_head;
+	size_t overflow_fds_head;
+	uint32_t overflow_fds_claimed;
+	size_t max_overflow;
+
+	/* Adaptive SO_SNDBUF sizing, enabled when sndbuf_max is not 0;
+	 * see wl_connection_set_sndbuf_range(). */
+	size_t sndbuf_min, sndbuf_max;
+	size_t sndbuf_queued;
+	uint64_t sndbuf_period_end;
+	struct wl_socket_buffer_stats sndbuf;
+
+	/* Holds a message that wraps around the end of the in buffer while
+	 * it is read through a wl_message_view. */
+	uint32_t view_scratch[RING_BUFFER_SIZE / sizeof(uint32_t)];
+};
+
+/* Header of a message in the overflow queue. fd_count is the number of
+ * fds at the front of overflow_fds that must be sent along with it. */
+struct overflow_msg {
+	uint32_t size;
+	uint32_t fd_count;
 };
 
+#define OVERFLOW_ALIGN(size) (((size) + 3) & ~(size_t) 3)
+
 static int
 ring_buffer_put(struct wl_ring_buffer *b, const void *data, size_t count)
 {
 	uint32_t head, size;
 
-	if (count > sizeof(b->data)) {
+	if (count > RING_BUFFER_SIZE) {
 		wl_log("Data too big for buffer (%d > %d).\n",
-		       count, sizeof(b->data));
+		       count, RING_BUFFER_SIZE);
 		errno = E2BIG;
 		return -1;
 	}
 
 	head = MASK(b->head);
-	if (head + count <= sizeof b->data) {
+	if (b->mirrored || head + count <= RING_BUFFER_SIZE) {
 		memcpy(b->data + head, data, count);
 	} else {
-		size = sizeof b->data - head;
+		size = RING_BUFFER_SIZE - head;
 		memcpy(b->data + head, data, size);
 		memcpy(b->data, (const char *) data + size, count - size);
 	}
@@ -104,17 +151,21 @@ ring_buffer_put_iov(struct wl_ring_buffer *b, struct iovec *iov, int *count)
 
 	head = MASK(b->head);
 	tail = MASK(b->tail);
-	if (head < tail) {
+	if (b->mirrored) {
+		iov[0].iov_base = b->data + head;
+		iov[0].iov_len = RING_BUFFER_SIZE - (b->head - b->tail);
+		*count = 1;
+	} else if (head < tail) {
 		iov[0].iov_base = b->data + head;
 		iov[0].iov_len = tail - head;
 		*count = 1;
 	} else if (tail == 0) {
 		iov[0].iov_base = b->data + head;
-		iov[0].iov_len = sizeof b->data - head;
+		iov[0].iov_len = RING_BUFFER_SIZE - head;
 		*count = 1;
 	} else {
 		iov[0].iov_base = b->data + head;
-		iov[0].iov_len = sizeof b->data - head;
+		iov[0].iov_len = RING_BUFFER_SIZE - head;
 		iov[1].iov_base = b->data;
 		iov[1].iov_len = tail;
 		*count = 2;
@@ -128,17 +179,21 @@ ring_buffer_get_iov(struct wl_ring_buffer *b, struct iovec *iov, int *count)
 
 	head = MASK(b->head);
 	tail = MASK(b->tail);
-	if (tail < head) {
+	if (b->mirrored) {
+		iov[0].iov_base = b->data + tail;
+		iov[0].iov_len = b->head - b->tail;
+		*count = 1;
+	} else if (tail < head) {
 		iov[0].iov_base = b->data + tail;
 		iov[0].iov_len = head - tail;
 		*count = 1;
 	} else if (head == 0) {
 		iov[0].iov_base = b->data + tail;
-		iov[0].iov_len = sizeof b->data - tail;
+		iov[0].iov_len = RING_BUFFER_SIZE - tail;
 		*count = 1;
 	} else {
 		iov[0].iov_base = b->data + tail;
-		iov[0].iov_len = sizeof b->data - tail;
+		iov[0].iov_len = RING_BUFFER_SIZE - tail;
 		iov[1].iov_base = b->data;
 		iov[1].iov_len = head;
 		*count = 2;
@@ -151,10 +206,10 @@ ring_buffer_copy(struct wl_ring_buffer *b, void *data, size_t count)
 	uint32_t tail, size;
 
 	tail = MASK(b->tail);
-	if (tail + count <= sizeof b->data) {
+	if (b->mirrored || tail + count <= RING_BUFFER_SIZE) {
 		memcpy(data, b->data + tail, count);
 	} else {
-		size = sizeof b->data - tail;
+		size = RING_BUFFER_SIZE - tail;
 		memcpy(data, b->data + tail, size);
 		memcpy((char *) data + size, b->data, count - size);
 	}
@@ -166,6 +221,79 @@ ring_buffer_size(struct wl_ring_buffer *b)
 	return b->head - b->tail;
 }
 
+static void
+ring_buffer_init(struct wl_ring_buffer *b)
+{
+	b->data = b->storage;
+	b->mirrored = false;
+}
+
+/* Back the ring buffer with a memfd mapped twice back to back. This
+ * only works if the ring buffer size is a multiple of the page size,
+ * otherwise the inline storage keeps being used. */
+static void
+ring_buffer_init_mirrored(struct wl_ring_buffer *b)
+{
+#ifdef HAVE_MEMFD_CREATE
+	char *base;
+	int fd;
+
+	ring_buffer_init(b);
+
+	if (sysconf(_SC_PAGESIZE) != RING_BUFFER_SIZE)
+		return;
+
+	fd = memfd_create("wayland-ring-buffer", MFD_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	if (ftruncate(fd, RING_BUFFER_SIZE) < 0)
+		goto err_fd;
+
+	base = mmap(NULL, 2 * RING_BUFFER_SIZE, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		goto err_fd;
+
+	if (mmap(base, RING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+	    mmap(base + RING_BUFFER_SIZE, RING_BUFFER_SIZE,
+		 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 fd, 0) == MAP_FAILED) {
+		munmap(base, 2 * RING_BUFFER_SIZE);
+		goto err_fd;
+	}
+
+	close(fd);
+
+	b->data = base;
+	b->mirrored = true;
+	return;
+
+err_fd:
+	close(fd);
+#else
+	ring_buffer_init(b);
+#endif
+}
+
+static void
+ring_buffer_release(struct wl_ring_buffer *b)
+{
+	if (b->mirrored)
+		munmap(b->data, 2 * RING_BUFFER_SIZE);
+}
+
+/* Mirrored ring buffers are opt-in, as they cost a memfd and two
+ * mappings per buffer to create. */
+static bool
+use_mirrored_ring_buffers(void)
+{
+	const char *mirrored = getenv("WAYLAND_MIRRORED_RING_BUFFERS");
+
+	return mirrored && strcmp(mirrored, "1") == 0;
+}
+
 struct wl_connection *
 wl_connection_create(int fd)
 {
@@ -177,13 +305,31 @@ wl_connection_create(int fd)
 
 	connection->fd = fd;
 
+	if (use_mirrored_ring_buffers()) {
+		ring_buffer_init_mirrored(&connection->in);
+		ring_buffer_init_mirrored(&connection->out);
+	} else {
+		ring_buffer_init(&connection->in);
+		ring_buffer_init(&connection->out);
+	}
+	ring_buffer_init(&connection->fds_in);
+	ring_buffer_init(&connection->fds_out);
+	wl_array_init(&connection->overflow);
+	wl_array_init(&connection->overflow_fds);
+
 	return connection;
 }
 
+bool
+wl_connection_is_mirrored(struct wl_connection *connection)
+{
+	return connection->in.mirrored && connection->out.mirrored;
+}
+
 static void
 close_fds(struct wl_ring_buffer *buffer, int max)
 {
-	int32_t fds[sizeof(buffer->data) / sizeof(int32_t)], i, count;
+	int32_t fds[RING_BUFFER_SIZE / sizeof(int32_t)], i, count;
 	size_t size;
 
 	size = ring_buffer_size(buffer);
@@ -211,13 +357,383 @@ wl_connection_destroy(struct wl_connection *connection)
 {
 	int fd = connection->fd;
 
+	int32_t *fd_out;
+
 	close_fds(&connection->fds_out, -1);
 	close_fds(&connection->fds_in, -1);
-	free(connection);
+	for (fd_out = (int32_t *) ((char *) connection->overflow_fds.data +
+				   connection->overflow_fds_head);
+	     (char *) fd_out < (char *) connection->overflow_fds.data +
+			       connection->overflow_fds.size;
+	     fd_out++)
+		close(*fd_out);
+	wl_priv_array_release(&connection->overflow_fds);
+	wl_priv_array_release(&connection->overflow);
+	ring_buffer_release(&connection->in);
+	ring_buffer_release(&connection->out);
+	wl_free(connection);
 
 	return fd;
 }
 
+void
+wl_connection_set_max_overflow(struct wl_connection *connection,
+			       size_t max_size)
+{
+	connection->max_overflow = max_size;
+}
+
+size_t
+wl_connection_overflow_size(struct wl_connection *connection)
+{
+	return connection->overflow.size - connection->overflow_head +
+	       connection->overflow_fds.size - connection->overflow_fds_head;
+}
+
+/* Milliseconds between two attempts at shrinking the send buffer */
+#define SNDBUF_PERIOD_MS 1000
+
+static uint64_t
+sndbuf_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+sndbuf_set(struct wl_connection *connection, size_t size)
+{
+	int value = size > INT_MAX ? INT_MAX : size;
+	socklen_t len = sizeof value;
+
+#ifdef __linux__
+	/* Linux doubles the value for its bookkeeping overhead, and
+	 * reports the doubled size, see socket(7) */
+	value /= 2;
+#endif
+	if (setsockopt(connection->fd, SOL_SOCKET, SO_SNDBUF,
+		       &value, sizeof value) < 0 ||
+	    getsockopt(connection->fd, SOL_SOCKET, SO_SNDBUF,
+		       &value, &len) < 0)
+		return -1;
+
+	connection->sndbuf.size = value;
+
+	return 0;
+}
+
+/* Double the send buffer after an EAGAIN. Returns true if it grew. */
+static bool
+sndbuf_grow(struct wl_connection *connection)
+{
+	size_t old = connection->sndbuf.size;
+	size_t size = old * 2;
+
+	if (old >= connection->sndbuf_max)
+		return false;
+
+	if (size > connection->sndbuf_max)
+		size = connection->sndbuf_max;
+	if (sndbuf_set(connection, size) < 0 ||
+	    connection->sndbuf.size <= old)
+		return false;
+
+	connection->sndbuf.grows++;
+
+	return true;
+}
+
+/* Note how much data the socket holds, or that it is full */
+static void
+sndbuf_sample(struct wl_connection *connection, bool full)
+{
+	size_t queued;
+	int value = 0;
+
+#ifdef SIOCOUTQ
+	if (!full && ioctl(connection->fd, SIOCOUTQ, &value) == 0)
+		queued = value;
+	else
+		queued = connection->sndbuf.size;
+#else
+	queued = full ? connection->sndbuf.size : 0;
+#endif
+
+	if (queued > connection->sndbuf_queued)
+		connection->sndbuf_queued = queued;
+	if (queued > connection->sndbuf.peak_queued)
+		connection->sndbuf.peak_queued = queued;
+}
+
+/* Once every SNDBUF_PERIOD_MS, shrink the buffer to twice the most data
+ * seen queued during the period if that at least halves it. */
+static void
+sndbuf_period_check(struct wl_connection *connection, uint64_t now)
+{
+	size_t size;
+
+	if (now < connection->sndbuf_period_end)
+		return;
+
+	size = connection->sndbuf_min;
+	while (size < connection->sndbuf_queued * 2)
+		size *= 2;
+	if (size * 2 <= connection->sndbuf.size &&
+	    sndbuf_set(connection, size) == 0)
+		connection->sndbuf.shrinks++;
+
+	connection->sndbuf_queued = 0;
+	connection->sndbuf_period_end = now + SNDBUF_PERIOD_MS;
+}
+
+static void
+sndbuf_update(struct wl_connection *connection, bool full)
+{
+	sndbuf_sample(connection, full);
+	sndbuf_period_check(connection, sndbuf_now());
+}
+
+static bool
+sndbuf_can_shrink(struct wl_connection *connection)
+{
+	return connection->sndbuf_max > 0 &&
+	       connection->sndbuf.size >= connection->sndbuf_min * 2;
+}
+
+/* Let the send buffer shrink while nothing is flushed. Returns the
+ * number of milliseconds until it should be called again, or -1 if the
+ * buffer cannot shrink any further. */
+int
+wl_connection_sndbuf_idle(struct wl_connection *connection)
+{
+	uint64_t now;
+
+	if (!sndbuf_can_shrink(connection))
+		return -1;
+
+	now = sndbuf_now();
+	sndbuf_sample(connection, false);
+	sndbuf_period_check(connection, now);
+	if (!sndbuf_can_shrink(connection))
+		return -1;
+
+	return connection->sndbuf_period_end - now;
+}
+
+/* Let the send buffer of the socket follow the bursts of data written
+ * to it, between min_size and max_size, or stop adapting it if
+ * max_size is 0. */
+int
+wl_connection_set_sndbuf_range(struct wl_connection *connection,
+			       size_t min_size, size_t max_size)
+{
+	int value;
+	socklen_t len = sizeof value;
+
+	if (max_size == 0) {
+		connection->sndbuf_max = 0;
+		return 0;
+	}
+
+	if (min_size == 0 || min_size > max_size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (connection->sndbuf_max == 0) {
+		if (getsockopt(connection->fd, SOL_SOCKET, SO_SNDBUF,
+			       &value, &len) < 0)
+			return -1;
+		memset(&connection->sndbuf, 0, sizeof connection->sndbuf);
+		connection->sndbuf.size = value;
+		connection->sndbuf.initial_size = value;
+		connection->sndbuf_queued = 0;
+		connection->sndbuf_period_end = sndbuf_now() + SNDBUF_PERIOD_MS;
+	}
+
+	connection->sndbuf_min = min_size;
+	connection->sndbuf_max = max_size;
+
+	if (connection->sndbuf.size < min_size)
+		return sndbuf_set(connection, min_size);
+	if (connection->sndbuf.size > max_size)
+		return sndbuf_set(connection, max_size);
+
+	return 0;
+}
+
+int
+wl_connection_get_sndbuf_stats(struct wl_connection *connection,
+			       struct wl_socket_buffer_stats *stats)
+{
+	if (connection->sndbuf_max == 0) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	*stats = connection->sndbuf;
+	if (stats->initial_size > stats->size)
+		stats->bytes_saved = stats->initial_size - stats->size;
+
+	return 0;
+}
+
+static bool
+overflow_pending(struct wl_connection *connection)
+{
+	return connection->overflow.size > connection->overflow_head ||
+	       connection->overflow_fds.size > connection->overflow_fds_head;
+}
+
+static int
+overflow_write(struct wl_connection *connection,
+	       const void *data, size_t count)
+{
+	struct overflow_msg *msg;
+	uint32_t fds;
+
+	if (count > RING_BUFFER_SIZE) {
+		wl_log("Data too big for buffer (%zu > %d).\n",
+		       count, RING_BUFFER_SIZE);
+		errno = E2BIG;
+		return -1;
+	}
+
+	if (wl_connection_overflow_size(connection) + sizeof *msg +
+	    OVERFLOW_ALIGN(count) > connection->max_overflow) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	msg = wl_priv_array_add(&connection->overflow,
+				sizeof *msg + OVERFLOW_ALIGN(count));
+	if (msg == NULL)
+		return -1;
+
+	/* All fds queued since the previous message belong to this one. */
+	fds = (connection->overflow_fds.size - connection->overflow_fds_head) /
+	      sizeof(int32_t);
+	msg->size = count;
+	msg->fd_count = fds - connection->overflow_fds_claimed;
+	connection->overflow_fds_claimed = fds;
+	memcpy(msg + 1, data, count);
+
+	return 0;
+}
+
+static int
+overflow_put_fd(struct wl_connection *connection, int32_t fd)
+{
+	int32_t *p;
+
+	if (wl_connection_overflow_size(connection) + sizeof fd >
+	    connection->max_overflow) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	p = wl_priv_array_add(&connection->overflow_fds, sizeof fd);
+	if (p == NULL)
+		return -1;
+
+	*p = fd;
+
+	return 0;
+}
+
+/* Drop head bytes from the front of an overflow queue, moving the rest
+ * down only once they are at least half of it. Returns the new head. */
+static size_t
+overflow_consume(struct wl_array *array, size_t head)
+{
+	if (head == array->size) {
+		array->size = 0;
+		return 0;
+	}
+
+	if (head < array->size / 2)
+		return head;
+
+	array->size -= head;
+	memmove(array->data, (char *) array->data + head, array->size);
+
+	return 0;
+}
+
+/* Move as many whole overflow messages, and the fds sent with them, into
+ * the out buffers as fit. Messages keep their order, and an fd is never
+ * moved after the message it belongs to. */
+static void
+overflow_drain(struct wl_connection *connection)
+{
+	struct overflow_msg *msg;
+	int32_t *fds;
+	char *p, *start, *end;
+	uint32_t fds_moved = 0;
+	size_t fds_size;
+
+	if (connection->overflow.size == connection->overflow_head)
+		return;
+
+	fds = (int32_t *) ((char *) connection->overflow_fds.data +
+			   connection->overflow_fds_head);
+	start = (char *) connection->overflow.data + connection->overflow_head;
+	end = (char *) connection->overflow.data + connection->overflow.size;
+	p = start;
+	while (p < end) {
+		msg = (struct overflow_msg *) p;
+		fds_size = msg->fd_count * sizeof fds[0];
+
+		if (ring_buffer_size(&connection->out) + msg->size >
+		    RING_BUFFER_SIZE ||
+		    ring_buffer_size(&connection->fds_out) + fds_size >
+		    MAX_FDS_OUT * sizeof fds[0])
+			break;
+
+		ring_buffer_put(&connection->fds_out,
+				fds + fds_moved, fds_size);
+		ring_buffer_put(&connection->out, msg + 1, msg->size);
+		fds_moved += msg->fd_count;
+		p += sizeof *msg + OVERFLOW_ALIGN(msg->size);
+	}
+
+	connection->overflow_head =
+		overflow_consume(&connection->overflow,
+				 connection->overflow_head + (p - start));
+	connection->overflow_fds_head =
+		overflow_consume(&connection->overflow_fds,
+				 connection->overflow_fds_head +
+				 fds_moved * sizeof fds[0]);
+	connection->overflow_fds_claimed -= fds_moved;
+}
+
+/* Make room for count bytes in the out buffer, flushing if needed.
+ * Returns 0 if the data should go to the out buffer, 1 if it has to
+ * be appended to the overflow queue instead, or -1 on error. */
+static int
+connection_reserve(struct wl_connection *connection, size_t count)
+{
+	struct wl_ring_buffer *b = &connection->out;
+
+	if (overflow_pending(connection))
+		return 1;
+
+	if (ring_buffer_size(b) + count <= RING_BUFFER_SIZE)
+		return 0;
+
+	connection->want_flush = 1;
+	if (wl_connection_flush(connection) >= 0)
+		return 0;
+
+	if (errno != EAGAIN || connection->max_overflow == 0)
+		return -1;
+
+	return ring_buffer_size(b) + count > RING_BUFFER_SIZE;
+}
+
 void
 wl_connection_copy(struct wl_connection *connection, void *data, size_t size)
 {
@@ -266,7 +782,7 @@ decode_cmsg(struct wl_ring_buffer *buffer, struct msghdr *msg)
 			continue;
 
 		size = cmsg->cmsg_len - CMSG_LEN(0);
-		max = sizeof(buffer->data) - ring_buffer_size(buffer);
+		max = RING_BUFFER_SIZE - ring_buffer_size(buffer);
 		if (size > max || overflow) {
 			overflow = 1;
 			size /= sizeof(int32_t);
@@ -294,11 +810,13 @@ wl_connection_flush(struct wl_connection *connection)
 	int len = 0, count;
 	size_t clen;
 	uint32_t tail;
+	bool grown = false;
 
 	if (!connection->want_flush)
 		return 0;
 
 	tail = connection->out.tail;
+	overflow_drain(connection);
 	while (connection->out.head - connection->out.tail > 0) {
 		ring_buffer_get_iov(&connection->out, iov, &count);
 
@@ -314,16 +832,32 @@ wl_connection_flush(struct wl_connection *connection)
 				      MSG_NOSIGNAL | MSG_DONTWAIT);
 		} while (len == -1 && errno == EINTR);
 
+		if (len == -1 && errno == EAGAIN && connection->sndbuf_max) {
+			if (sndbuf_grow(connection)) {
+				grown = true;
+				continue;
+			}
+			sndbuf_update(connection, true);
+			errno = EAGAIN;
+		}
+
 		if (len == -1)
 			return -1;
 
 		close_fds(&connection->fds_out, MAX_FDS_OUT);
 
 		connection->out.tail += len;
+		overflow_drain(connection);
 	}
 
 	connection->want_flush = 0;
 
+	if (connection->sndbuf_max) {
+		if (grown)
+			connection->sndbuf.eagain_avoided++;
+		sndbuf_update(connection, false);
+	}
+
 	return connection->out.head - tail;
 }
 
@@ -341,7 +875,7 @@ wl_connection_read(struct wl_connection *connection)
 	char cmsg[CLEN];
 	int len, count, ret;
 
-	if (ring_buffer_size(&connection->in) >= sizeof(connection->in.data)) {
+	if (ring_buffer_size(&connection->in) >= RING_BUFFER_SIZE) {
 		errno = EOVERFLOW;
 		return -1;
 	}
@@ -369,6 +903,10 @@ wl_connection_read(struct wl_connection *connection)
 
 	connection->in.head += len;
 
+	/* Connections that stopped sending still shrink on the next read */
+	if (sndbuf_can_shrink(connection))
+		wl_connection_sndbuf_idle(connection);
+
 	return wl_connection_pending_input(connection);
 }
 
@@ -376,14 +914,7 @@ int
 wl_connection_write(struct wl_connection *connection,
 		    const void *data, size_t count)
 {
-	if (connection->out.head - connection->out.tail +
-	    count > ARRAY_LENGTH(connection->out.data)) {
-		connection->want_flush = 1;
-		if (wl_connection_flush(connection) < 0)
-			return -1;
-	}
-
-	if (ring_buffer_put(&connection->out, data, count) < 0)
+	if (wl_connection_queue(connection, data, count) < 0)
 		return -1;
 
 	connection->want_flush = 1;
@@ -395,14 +926,15 @@ int
 wl_connection_queue(struct wl_connection *connection,
 		    const void *data, size_t count)
 {
-	if (connection->out.head - connection->out.tail +
-	    count > ARRAY_LENGTH(connection->out.data)) {
+	switch (connection_reserve(connection, count)) {
+	case 0:
+		return ring_buffer_put(&connection->out, data, count);
+	case 1:
 		connection->want_flush = 1;
-		if (wl_connection_flush(connection) < 0)
-			return -1;
+		return overflow_write(connection, data, count);
+	default:
+		return -1;
 	}
-
-	return ring_buffer_put(&connection->out, data, count);
 }
 
 int
@@ -427,10 +959,18 @@ wl_connection_get_fd(struct wl_connection *connection)
 static int
 wl_connection_put_fd(struct wl_connection *connection, int32_t fd)
 {
+	if (overflow_pending(connection))
+		return overflow_put_fd(connection, fd);
+
 	if (ring_buffer_size(&connection->fds_out) == MAX_FDS_OUT * sizeof fd) {
 		connection->want_flush = 1;
-		if (wl_connection_flush(connection) < 0)
-			return -1;
+		if (wl_connection_flush(connection) < 0) {
+			if (errno != EAGAIN || connection->max_overflow == 0)
+				return -1;
+			if (ring_buffer_size(&connection->fds_out) ==
+			    MAX_FDS_OUT * sizeof fd)
+				return overflow_put_fd(connection, fd);
+		}
 	}
 
 	return ring_buffer_put(&connection->fds_out, &fd, sizeof fd);
@@ -536,7 +1076,7 @@ wl_argument_from_va_list(const char *signature, union wl_argument *args,
 	}
 }
 
-static void
+void
 wl_closure_clear_fds(struct wl_closure *closure)
 {
 	const char *signature = closure->message->signature;
@@ -600,16 +1140,47 @@ wl_closure_marshal(struct wl_object *sender, uint32_t opcode,
 		   const struct wl_message *message)
 {
 	struct wl_closure *closure;
+
+	closure = zalloc(sizeof *closure);
+	if (closure == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (wl_closure_marshal_in_place(closure, sender, opcode,
+					args, message) < 0) {
+		wl_free(closure);
+		return NULL;
+	}
+
+	return closure;
+}
+
+/* Like wl_closure_marshal(), but into a closure owned by the caller,
+ * which must be released with wl_closure_close_fds() instead of
+ * wl_closure_destroy(). Only the fields used to send it are set. */
+int
+wl_closure_marshal_in_place(struct wl_closure *closure,
+			    struct wl_object *sender, uint32_t opcode,
+			    union wl_argument *args,
+			    const struct wl_message *message)
+{
 	struct wl_object *object;
 	int i, count, fd, dup_fd;
 	const char *signature;
 	struct argument_details arg;
 
-	closure = wl_closure_init(message, 0, NULL, args);
-	if (closure == NULL)
-		return NULL;
+	count = arg_count_for_signature(message->signature);
+	if (count > WL_CLOSURE_MAX_ARGS) {
+		wl_log("too many args (%d)\n", count);
+		errno = EINVAL;
+		return -1;
+	}
 
-	count = closure->count;
+	memcpy(closure->args, args, count * sizeof *args);
+	closure->message = message;
+	closure->count = count;
+	wl_closure_clear_fds(closure);
 
 	signature = message->signature;
 	for (i = 0; i < count; i++) {
@@ -643,10 +1214,10 @@ wl_closure_marshal(struct wl_object *sender, uint32_t opcode,
 			fd = args[i].h;
 			dup_fd = wl_os_dupfd_cloexec(fd, 0);
 			if (dup_fd < 0) {
-				wl_closure_destroy(closure);
+				wl_closure_close_fds(closure);
 				wl_log("error marshalling arguments for %s: dup failed: %s\n",
 				       message->name, strerror(errno));
-				return NULL;
+				return -1;
 			}
 			closure->args[i].h = dup_fd;
 			break;
@@ -659,15 +1230,15 @@ wl_closure_marshal(struct wl_object *sender, uint32_t opcode,
 	closure->sender_id = sender->id;
 	closure->opcode = opcode;
 
-	return closure;
+	return 0;
 
 err_null:
-	wl_closure_destroy(closure);
+	wl_closure_close_fds(closure);
 	wl_log("error marshalling arguments for %s (signature %s): "
 	       "null value passed for arg %i\n", message->name,
 	       message->signature, i);
 	errno = EINVAL;
-	return NULL;
+	return -1;
 }
 
 struct wl_closure *
@@ -870,6 +1441,238 @@ wl_connection_demarshal(struct wl_connection *connection,
 	return NULL;
 }
 
+static void
+close_view_fds(struct wl_message_view *view, const struct wl_message *message,
+	       int count)
+{
+	const char *signature = message->signature;
+	struct argument_details arg;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		signature = get_next_argument(signature, &arg);
+		if (arg.type == 'h')
+			close(view->args[i].h);
+	}
+}
+
+/* Validates the message of the given size at the head of the in buffer
+ * like wl_connection_demarshal() and wl_closure_lookup_objects() would,
+ * and sets up view to read it in place. The message is not consumed,
+ * except for its fds, which are handed over with the view. */
+int
+wl_connection_view(struct wl_connection *connection, uint32_t size,
+		   struct wl_map *objects, const struct wl_message *message,
+		   struct wl_message_view *view)
+{
+	const uint32_t *words, *p, *end;
+	uint32_t tail, length, length_in_u32, id;
+	struct wl_object *object;
+	const char *signature;
+	struct argument_details arg;
+	int i, count, fd;
+
+	if (size < 2 * sizeof *p || size % sizeof *p != 0) {
+		wl_log("invalid message size (%u), message %s(%s)\n",
+		       size, message->name, message->signature);
+		errno = EINVAL;
+		return -1;
+	}
+
+	count = arg_count_for_signature(message->signature);
+	if (count > WL_MESSAGE_VIEW_MAX_ARGS) {
+		wl_log("too many args (%d)\n", count);
+		errno = EINVAL;
+		return -1;
+	}
+
+	tail = MASK(connection->in.tail);
+	if (tail % sizeof *p == 0 &&
+	    (connection->in.mirrored || tail + size <= RING_BUFFER_SIZE)) {
+		words = (const uint32_t *) (connection->in.data + tail);
+	} else {
+		ring_buffer_copy(&connection->in, connection->view_scratch,
+				 size);
+		words = connection->view_scratch;
+	}
+
+	p = words + 2;
+	end = words + size / sizeof *p;
+
+	signature = message->signature;
+	for (i = 0; i < count; i++) {
+		signature = get_next_argument(signature, &arg);
+
+		if (arg.type != 'h' && p + 1 > end)
+			goto too_short;
+
+		view->offsets[i] = p - words;
+
+		switch (arg.type) {
+		case 'u':
+		case 'i':
+		case 'f':
+			p++;
+			break;
+		case 's':
+			length = *p++;
+
+			if (length == 0 && !arg.nullable) {
+				wl_log("NULL string received on non-nullable "
+				       "type, message %s(%s)\n", message->name,
+				       message->signature);
+				goto err;
+			}
+
+			length_in_u32 = div_roundup(length, sizeof *p);
+			if ((uint32_t) (end - p) < length_in_u32)
+				goto too_short;
+
+			if (length > 0 && ((const char *) p)[length - 1] != '\0') {
+				wl_log("string not nul-terminated, "
+				       "message %s(%s)\n",
+				       message->name, message->signature);
+				goto err;
+			}
+
+			p += length_in_u32;
+			break;
+		case 'o':
+			id = *p++;
+
+			if (id == 0 && !arg.nullable) {
+				wl_log("NULL object received on non-nullable "
+				       "type, message %s(%s)\n", message->name,
+				       message->signature);
+				goto err;
+			}
+
+			object = wl_map_lookup(objects, id);
+			if (wl_object_is_zombie(objects, id)) {
+				object = NULL;
+			} else if (object == NULL && id != 0) {
+				wl_log("unknown object (%u), message %s(%s)\n",
+				       id, message->name, message->signature);
+				goto err;
+			}
+
+			if (object != NULL && message->types[i] != NULL &&
+			    !wl_interface_equal(object->interface,
+						message->types[i])) {
+				wl_log("invalid object (%u), type (%s), "
+				       "message %s(%s)\n",
+				       id, object->interface->name,
+				       message->name, message->signature);
+				goto err;
+			}
+
+			view->args[i].o = object;
+			break;
+		case 'n':
+			id = *p++;
+
+			if (id == 0) {
+				wl_log("NULL new ID received on non-nullable "
+				       "type, message %s(%s)\n", message->name,
+				       message->signature);
+				goto err;
+			}
+
+			if (wl_map_reserve_new(objects, id) < 0) {
+				if (errno == EINVAL) {
+					wl_log("not a valid new object id (%u), "
+					       "message %s(%s)\n", id,
+					       message->name,
+					       message->signature);
+				}
+				close_view_fds(view, message, i);
+				return -1;
+			}
+			break;
+		case 'a':
+			length = *p++;
+
+			length_in_u32 = div_roundup(length, sizeof *p);
+			if ((uint32_t) (end - p) < length_in_u32)
+				goto too_short;
+
+			p += length_in_u32;
+			break;
+		case 'h':
+			if (connection->fds_in.tail == connection->fds_in.head) {
+				wl_log("file descriptor expected, "
+				       "object (%d), message %s(%s)\n",
+				       words[0], message->name,
+				       message->signature);
+				goto err;
+			}
+
+			ring_buffer_copy(&connection->fds_in, &fd, sizeof fd);
+			connection->fds_in.tail += sizeof fd;
+			view->offsets[i] = 0;
+			view->args[i].h = fd;
+			break;
+		default:
+			wl_abort("unknown type\n");
+			break;
+		}
+	}
+
+	view->words = words;
+
+	return 0;
+
+ too_short:
+	wl_log("message too short, object (%d), message %s(%s)\n",
+	       words[0], message->name, message->signature);
+ err:
+	close_view_fds(view, message, i);
+	errno = EINVAL;
+	return -1;
+}
+
+/* Sets up view to read the arguments of a closure received with
+ * wl_connection_demarshal(), whose fds are handed over with the view. */
+void
+wl_closure_view(struct wl_closure *closure, struct wl_message_view *view)
+{
+	const struct wl_message *message = closure->message;
+	const char *signature = message->signature;
+	struct argument_details arg;
+	const uint32_t *words, *p;
+	int i;
+
+	words = (const uint32_t *)
+		(closure->extra + wl_message_count_arrays(message));
+	p = words + 2;
+
+	for (i = 0; i < closure->count; i++) {
+		signature = get_next_argument(signature, &arg);
+		view->offsets[i] = p - words;
+
+		switch (arg.type) {
+		case 's':
+		case 'a':
+			p += 1 + div_roundup(*p, sizeof *p);
+			break;
+		case 'o':
+			view->args[i].o = closure->args[i].o;
+			p++;
+			break;
+		case 'h':
+			view->offsets[i] = 0;
+			view->args[i].h = closure->args[i].h;
+			break;
+		default:
+			p++;
+			break;
+		}
+	}
+
+	view->words = words;
+	wl_closure_clear_fds(closure);
+}
+
 bool
 wl_object_is_zombie(struct wl_map *map, uint32_t id)
 {
@@ -1171,6 +1974,8 @@ serialize_closure(struct wl_closure *closure, uint32_t *buffer,
 			if (p + div_roundup(size, sizeof *p) > end)
 				goto overflow;
 
+			/* Do not leak what was in the buffer as padding */
+			p[div_roundup(size, sizeof *p) - 1] = 0;
 			memcpy(p, closure->args[i].s, size);
 			p += div_roundup(size, sizeof *p);
 			break;
@@ -1186,6 +1991,8 @@ serialize_closure(struct wl_closure *closure, uint32_t *buffer,
 			if (p + div_roundup(size, sizeof *p) > end)
 				goto overflow;
 
+			if (size > 0)
+				p[div_roundup(size, sizeof *p) - 1] = 0;
 			memcpy(p, closure->args[i].a->data, size);
 			p += div_roundup(size, sizeof *p);
 			break;
@@ -1206,6 +2013,40 @@ overflow:
 	return -1;
 }
 
+/* Serialize a closure straight into a mirrored output buffer, where
+ * the free space after the head is always contiguous. Returns 1 without
+ * serializing if the closure has to go to the overflow queue instead. */
+static int
+serialize_closure_to_ring(struct wl_closure *closure,
+			  struct wl_connection *connection,
+			  uint32_t buffer_size)
+{
+	struct wl_ring_buffer *b = &connection->out;
+	size_t count = buffer_size * sizeof(uint32_t);
+	int size, ret;
+
+	if (count > RING_BUFFER_SIZE) {
+		wl_log("Data too big for buffer (%zu > %d).\n",
+		       count, RING_BUFFER_SIZE);
+		errno = E2BIG;
+		return -1;
+	}
+
+	ret = connection_reserve(connection, count);
+	if (ret != 0)
+		return ret;
+
+	size = serialize_closure(closure,
+				 (uint32_t *) (b->data + MASK(b->head)),
+				 buffer_size);
+	if (size < 0)
+		return -1;
+
+	b->head += size;
+
+	return 0;
+}
+
 int
 wl_closure_send(struct wl_closure *closure, struct wl_connection *connection)
 {
@@ -1218,22 +2059,116 @@ wl_closure_send(struct wl_closure *closure, struct wl_connection *connection)
 		return -1;
 
 	buffer_size = buffer_size_for_closure(closure);
+
+	if (connection->out.mirrored) {
+		result = serialize_closure_to_ring(closure, connection,
+						   buffer_size);
+		if (result == 0)
+			connection->want_flush = 1;
+		if (result <= 0)
+			return result;
+	}
+
 	buffer = zalloc(buffer_size * sizeof buffer[0]);
 	if (buffer == NULL)
 		return -1;
 
 	size = serialize_closure(closure, buffer, buffer_size);
 	if (size < 0) {
-		free(buffer);
+		wl_free(buffer);
 		return -1;
 	}
 
 	result = wl_connection_write(connection, buffer, size);
-	free(buffer);
+	wl_free(buffer);
 
 	return result;
 }
 
+/* Write a run of messages that fits the out buffer with a single
+ * reservation, straight into a mirrored buffer when there is room. */
+static int
+send_closure_run(struct wl_closure *closures, const uint32_t *sizes,
+		 int count, uint32_t total, struct wl_connection *connection)
+{
+	struct wl_ring_buffer *b = &connection->out;
+	uint32_t buffer[RING_BUFFER_SIZE / sizeof(uint32_t)];
+	uint32_t *p;
+	int i, size, ret;
+
+	ret = connection_reserve(connection, total * sizeof(uint32_t));
+	if (ret < 0)
+		return -1;
+
+	if (ret == 0 && b->mirrored)
+		p = (uint32_t *) (b->data + MASK(b->head));
+	else
+		p = buffer;
+
+	total = 0;
+	for (i = 0; i < count; i++) {
+		size = serialize_closure(&closures[i], p + total, sizes[i]);
+		if (size < 0)
+			return -1;
+		total += size / sizeof(uint32_t);
+	}
+
+	if (p != buffer) {
+		b->head += total * sizeof(uint32_t);
+		return 0;
+	}
+
+	return wl_connection_queue(connection, buffer,
+				   total * sizeof(uint32_t));
+}
+
+/* Send count closures to the same connection: the space for as many
+ * messages as fit in the out buffer is reserved at once, and they are
+ * serialized back to back. With flush false, this acts like
+ * wl_closure_queue() for each closure, else like wl_closure_send(). */
+int
+wl_closure_send_array(struct wl_closure *closures, int count,
+		      struct wl_connection *connection, bool flush)
+{
+	uint32_t sizes[WL_CLOSURE_BATCH_MAX];
+	uint32_t total = 0;
+	int i, start = 0;
+
+	assert(count <= WL_CLOSURE_BATCH_MAX);
+
+	for (i = 0; i < count; i++) {
+		if (copy_fds_to_connection(&closures[i], connection))
+			return -1;
+
+		sizes[i] = buffer_size_for_closure(&closures[i]);
+		if (sizes[i] * sizeof(uint32_t) > RING_BUFFER_SIZE) {
+			wl_log("Data too big for buffer (%zu > %d).\n",
+			       sizes[i] * sizeof(uint32_t), RING_BUFFER_SIZE);
+			errno = E2BIG;
+			return -1;
+		}
+
+		if ((total + sizes[i]) * sizeof(uint32_t) > RING_BUFFER_SIZE) {
+			if (send_closure_run(closures + start, sizes + start,
+					     i - start, total, connection) < 0)
+				return -1;
+			start = i;
+			total = 0;
+		}
+		total += sizes[i];
+	}
+
+	if (total > 0 &&
+	    send_closure_run(closures + start, sizes + start,
+			     count - start, total, connection) < 0)
+		return -1;
+
+	if (flush)
+		connection->want_flush = 1;
+
+	return 0;
+}
+
 int
 wl_closure_queue(struct wl_closure *closure, struct wl_connection *connection)
 {
@@ -1246,18 +2181,26 @@ wl_closure_queue(struct wl_closure *closure, struct wl_connection *connection)
 		return -1;
 
 	buffer_size = buffer_size_for_closure(closure);
-	buffer = malloc(buffer_size * sizeof buffer[0]);
+
+	if (connection->out.mirrored) {
+		result = serialize_closure_to_ring(closure, connection,
+						   buffer_size);
+		if (result <= 0)
+			return result;
+	}
+
+	buffer = wl_malloc(buffer_size * sizeof buffer[0]);
 	if (buffer == NULL)
 		return -1;
 
 	size = serialize_closure(closure, buffer, buffer_size);
 	if (size < 0) {
-		free(buffer);
+		wl_free(buffer);
 		return -1;
 	}
 
 	result = wl_connection_queue(connection, buffer, size);
-	free(buffer);
+	wl_free(buffer);
 
 	return result;
 }
@@ -1361,7 +2304,7 @@ wl_closure_print(struct wl_closure *closure, struct wl_object *target,
 	}
 }
 
-static int
+int
 wl_closure_close_fds(struct wl_closure *closure)
 {
 	int i;
@@ -1385,5 +2328,5 @@ wl_closure_destroy(struct wl_closure *closure)
 		return;
 
 	wl_closure_close_fds(closure);
-	free(closure);
+	wl_free(closure);
 }
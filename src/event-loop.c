@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -48,6 +49,11 @@
 
 #define TIMER_REMOVED -2
 
+/* Number of epoll events fetched per wl_event_loop_dispatch() call by
+ * default, and the limit up to which that grows when it is not enough */
+#define EPOLL_EVENTS_DEFAULT 32
+#define EPOLL_EVENTS_ADAPTIVE_MAX 1024
+
 struct wl_event_loop;
 struct wl_event_source_interface;
 struct wl_event_source_timer;
@@ -58,6 +64,10 @@ struct wl_event_source {
 	struct wl_list link;
 	void *data;
 	int fd;
+	enum wl_event_priority priority;
+	/* Link in the loop's deferred_list while deferred is set */
+	bool deferred;
+	struct wl_list defer_link;
 };
 
 struct wl_timer_heap {
@@ -76,6 +86,31 @@ struct wl_event_loop {
 	struct wl_signal destroy_signal;
 
 	struct wl_timer_heap timers;
+
+	/* Classes below deadline_priority are deferred past the deadline */
+	bool has_deadline;
+	enum wl_event_priority deadline_priority;
+	struct timespec deadline;
+
+	/* Fixed epoll batch size, or 0 to grow it when it fills up.
+	 * Batches above EPOLL_EVENTS_DEFAULT live in events, which nested
+	 * dispatches don't use while events_busy is set. */
+	int max_events;
+	struct epoll_event *events;
+	int events_size;
+	bool events_busy;
+
+	/* Rotates the order ready sources are dispatched in */
+	unsigned int dispatch_start;
+
+	/* Set by wl_event_loop_dispatch_until() for the duration of the
+	 * call, client class sources are not dispatched past it */
+	bool has_dispatch_deadline;
+	bool dispatch_deadline_passed;
+	bool dispatched_client;
+	struct timespec dispatch_deadline;
+	/* Sources that stopped with work left when out of time */
+	struct wl_list deferred_list;
 };
 
 struct wl_event_source_interface {
@@ -123,12 +158,13 @@ add_source(struct wl_event_loop *loop,
 	struct epoll_event ep;
 
 	if (source->fd < 0) {
-		free(source);
+		wl_free(source);
 		return NULL;
 	}
 
 	source->loop = loop;
 	source->data = data;
+	source->priority = WL_EVENT_PRIORITY_CLIENT;
 	wl_list_init(&source->link);
 
 	memset(&ep, 0, sizeof ep);
@@ -140,7 +176,7 @@ add_source(struct wl_event_loop *loop,
 
 	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &ep) < 0) {
 		close(source->fd);
-		free(source);
+		wl_free(source);
 		return NULL;
 	}
 
@@ -299,7 +335,7 @@ wl_timer_heap_release(struct wl_timer_heap *timers)
 	if (timers->base.fd != -1) {
 		close(timers->base.fd);
 	}
-	free(timers->data);
+	wl_free(timers->data);
 }
 
 static int
@@ -338,7 +374,7 @@ wl_timer_heap_reserve(struct wl_timer_heap *timers)
 
 	if (timers->count + 1 > timers->space) {
 		new_space = timers->space >= 8 ? timers->space * 2 : 8;
-		n = realloc(timers->data, (size_t)new_space * sizeof(*n));
+		n = wl_realloc(timers->data, (size_t)new_space * sizeof(*n));
 		if (!n) {
 			wl_log("Allocation failure when expanding timer list\n");
 			return -1;
@@ -359,7 +395,7 @@ wl_timer_heap_unreserve(struct wl_timer_heap *timers)
 	timers->count--;
 
 	if (timers->space >= 16 && timers->space >= 4 * timers->count) {
-		n = realloc(timers->data, (size_t)timers->space / 2 * sizeof(*n));
+		n = wl_realloc(timers->data, (size_t)timers->space / 2 * sizeof(*n));
 		if (!n) {
 			wl_log("Reallocation failure when shrinking timer list\n");
 			return;
@@ -584,7 +620,7 @@ wl_event_loop_add_timer(struct wl_event_loop *loop,
 	source->heap_idx = -1;
 
 	if (wl_timer_heap_reserve(&loop->timers) < 0) {
-		free(source);
+		wl_free(source);
 		return NULL;
 	}
 
@@ -849,19 +885,299 @@ wl_event_source_remove(struct wl_event_source *source)
 		source->fd = TIMER_REMOVED;
 	}
 
+	if (source->deferred) {
+		wl_list_remove(&source->defer_link);
+		source->deferred = false;
+	}
+
 	wl_list_remove(&source->link);
 	wl_list_insert(&loop->destroy_list, &source->link);
 
 	return 0;
 }
 
+/** Set the dispatch priority class of an event source
+ *
+ * \param source The event source.
+ * \param priority The new priority class.
+ * \return 0 on success, -1 with errno set to EINVAL if \a priority is
+ * not a valid class.
+ *
+ * Ready fd and signal sources are dispatched in order of their priority
+ * class, so that e.g. input devices are handled before client
+ * connections that became ready in the same wl_event_loop_dispatch()
+ * call. New sources are in the WL_EVENT_PRIORITY_CLIENT class.
+ *
+ * Timer sources are always dispatched before all other sources and idle
+ * sources after them, so their priority class has no effect.
+ *
+ * \sa wl_event_loop_set_priority_deadline()
+ * \memberof wl_event_source
+ */
+WL_EXPORT int
+wl_event_source_set_priority(struct wl_event_source *source,
+			     enum wl_event_priority priority)
+{
+	if (priority < WL_EVENT_PRIORITY_INPUT ||
+	    priority > WL_EVENT_PRIORITY_BACKGROUND) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	source->priority = priority;
+
+	return 0;
+}
+
+/** Defer lower priority sources once a deadline has passed
+ *
+ * \param loop The event loop context.
+ * \param priority The lowest priority class that is never deferred.
+ * \param deadline Absolute CLOCK_MONOTONIC deadline, or NULL to clear it.
+ *
+ * While a deadline is set, wl_event_loop_dispatch() checks the clock
+ * after dispatching each priority class. Once the deadline has passed,
+ * ready sources in classes below \a priority are left for the next
+ * wl_event_loop_dispatch() call, which will find them ready again
+ * right away. Classes at or above \a priority are always dispatched,
+ * and so is the highest ready class, so sources are only ever deferred
+ * in favour of sources of a higher class.
+ *
+ * A compositor can use this to make sure that e.g. the work needed for
+ * the next output frame is not delayed by client traffic, by setting
+ * the deadline to the point where the frame must be started and
+ * \a priority to WL_EVENT_PRIORITY_DISPLAY.
+ *
+ * The deadline stays in effect until it is changed or cleared.
+ *
+ * \sa wl_event_source_set_priority()
+ * \memberof wl_event_loop
+ */
+WL_EXPORT void
+wl_event_loop_set_priority_deadline(struct wl_event_loop *loop,
+				    enum wl_event_priority priority,
+				    const struct timespec *deadline)
+{
+	if (deadline == NULL) {
+		loop->has_deadline = false;
+		return;
+	}
+
+	loop->has_deadline = true;
+	loop->deadline_priority = priority;
+	loop->deadline = *deadline;
+}
+
+static int
+wl_event_loop_resize_events(struct wl_event_loop *loop, int size)
+{
+	struct epoll_event *events;
+
+	/* The default and smaller batches fit on the stack */
+	if (size <= EPOLL_EVENTS_DEFAULT) {
+		wl_free(loop->events);
+		loop->events = NULL;
+		loop->events_size = 0;
+		return 0;
+	}
+
+	events = wl_realloc(loop->events, size * sizeof *events);
+	if (events == NULL)
+		return -1;
+
+	loop->events = events;
+	loop->events_size = size;
+
+	return 0;
+}
+
+/** Set how many ready sources are fetched from the kernel at once
+ *
+ * \param loop The event loop context.
+ * \param max_events The number of sources, or 0 to pick it automatically.
+ * \return 0 on success, -1 with errno set to EINVAL if \a max_events is
+ * negative or ENOMEM if the buffer could not be allocated.
+ *
+ * wl_event_loop_dispatch() dispatches at most this many ready sources.
+ * Any others stay ready for the next call, which first runs the idle
+ * and post-dispatch work of this one.
+ *
+ * By default this starts at 32 and doubles, up to 1024, whenever a call
+ * finds more sources ready than it can fetch. Setting a fixed number
+ * stops that.
+ *
+ * \memberof wl_event_loop
+ */
+WL_EXPORT int
+wl_event_loop_set_max_events(struct wl_event_loop *loop, int max_events)
+{
+	if (max_events < 0 ||
+	    (size_t) max_events > SIZE_MAX / sizeof *loop->events) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	loop->max_events = max_events;
+
+	/* Otherwise done by the wl_event_loop_dispatch() using it */
+	if (!loop->events_busy &&
+	    wl_event_loop_resize_events(loop, max_events) < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+wl_event_loop_adapt_events(struct wl_event_loop *loop, int count, int size)
+{
+	if (loop->events_busy)
+		return;
+
+	if (loop->max_events == 0) {
+		if (count == size && size < EPOLL_EVENTS_ADAPTIVE_MAX)
+			wl_event_loop_resize_events(loop, size * 2);
+	} else if (loop->events_size != loop->max_events &&
+		   (loop->events || loop->max_events > EPOLL_EVENTS_DEFAULT)) {
+		wl_event_loop_resize_events(loop, loop->max_events);
+	}
+}
+
+static bool
+wl_event_loop_deadline_passed(struct wl_event_loop *loop,
+			      enum wl_event_priority priority)
+{
+	struct timespec now;
+
+	if (!loop->has_deadline || priority <= loop->deadline_priority)
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return !time_lt(now, loop->deadline);
+}
+
+/** \cond INTERNAL */
+
+/* Whether a wl_event_loop_dispatch_until() deadline has passed.  Once it
+ * has, it stays passed for the rest of the call without another clock
+ * read. */
+bool
+wl_event_loop_out_of_time(struct wl_event_loop *loop)
+{
+	struct timespec now;
+
+	if (!loop->has_dispatch_deadline)
+		return false;
+	if (loop->dispatch_deadline_passed)
+		return true;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	loop->dispatch_deadline_passed =
+		!time_lt(now, loop->dispatch_deadline);
+
+	return loop->dispatch_deadline_passed;
+}
+
+/* Dispatch a source again in the next wl_event_loop_dispatch() call,
+ * whether or not its fd is ready by then.  For fd sources that stop
+ * early when out of time but have already read their input. */
+void
+wl_event_source_defer(struct wl_event_source *source)
+{
+	if (source->deferred)
+		return;
+
+	source->deferred = true;
+	wl_list_insert(source->loop->deferred_list.prev, &source->defer_link);
+}
+
+/** \endcond */
+
+static void
+wl_event_source_undefer(struct wl_event_source *source)
+{
+	wl_list_remove(&source->defer_link);
+	source->deferred = false;
+}
+
+/* Once out of time, client class sources are left for the next call.
+ * The first one is always dispatched, so that clients make progress even
+ * if every call starts late. */
+static bool
+wl_event_loop_may_dispatch(struct wl_event_loop *loop,
+			   struct wl_event_source *source)
+{
+	if (!loop->has_dispatch_deadline ||
+	    source->priority < WL_EVENT_PRIORITY_CLIENT)
+		return true;
+
+	if (!loop->dispatched_client) {
+		loop->dispatched_client = true;
+		return true;
+	}
+
+	return !wl_event_loop_out_of_time(loop);
+}
+
+static void
+wl_event_loop_dispatch_deferred(struct wl_event_loop *loop)
+{
+	struct wl_event_source *source;
+	struct epoll_event ep;
+	struct wl_list pending;
+
+	/* Sources may be removed or deferred again while dispatching */
+	wl_list_init(&pending);
+	wl_list_insert_list(&pending, &loop->deferred_list);
+	wl_list_init(&loop->deferred_list);
+
+	memset(&ep, 0, sizeof ep);
+	while (!wl_list_empty(&pending)) {
+		source = wl_container_of(pending.next, source, defer_link);
+		wl_list_remove(&source->defer_link);
+		wl_list_init(&source->defer_link);
+		source->deferred = false;
+
+		if (!wl_event_loop_may_dispatch(loop, source)) {
+			wl_event_source_defer(source);
+			continue;
+		}
+
+		ep.data.ptr = source;
+		source->interface->dispatch(source, &ep);
+	}
+}
+
+/* Milliseconds until the dispatch deadline, rounded up */
+static int
+wl_event_loop_deadline_timeout(struct wl_event_loop *loop, int timeout)
+{
+	struct timespec now;
+	int64_t ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (loop->dispatch_deadline.tv_sec - now.tv_sec) * 1000 +
+	     (loop->dispatch_deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+	if (ms < 0)
+		ms = 0;
+	else if (ms > INT_MAX)
+		ms = INT_MAX;
+
+	if (timeout < 0 || ms < timeout)
+		return ms;
+
+	return timeout;
+}
+
 static void
 wl_event_loop_process_destroy_list(struct wl_event_loop *loop)
 {
 	struct wl_event_source *source, *next;
 
 	wl_list_for_each_safe(source, next, &loop->destroy_list, link)
-		free(source);
+		wl_free(source);
 
 	wl_list_init(&loop->destroy_list);
 }
@@ -891,12 +1207,13 @@ wl_event_loop_create(void)
 
 	loop->epoll_fd = wl_os_epoll_create_cloexec();
 	if (loop->epoll_fd < 0) {
-		free(loop);
+		wl_free(loop);
 		return NULL;
 	}
 	wl_list_init(&loop->check_list);
 	wl_list_init(&loop->idle_list);
 	wl_list_init(&loop->destroy_list);
+	wl_list_init(&loop->deferred_list);
 
 	wl_signal_init(&loop->destroy_signal);
 
@@ -925,8 +1242,9 @@ wl_event_loop_destroy(struct wl_event_loop *loop)
 
 	wl_event_loop_process_destroy_list(loop);
 	wl_timer_heap_release(&loop->timers);
+	wl_free(loop->events);
 	close(loop->epoll_fd);
-	free(loop);
+	wl_free(loop);
 }
 
 static bool
@@ -994,21 +1312,45 @@ wl_event_loop_dispatch_idle(struct wl_event_loop *loop)
 WL_EXPORT int
 wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout)
 {
-	struct epoll_event ep[32];
+	struct epoll_event stack_ep[EPOLL_EVENTS_DEFAULT];
+	struct epoll_event *ep = stack_ep;
 	struct wl_event_source *source;
-	int i, count;
+	int i, n, start, count, size;
 	bool has_timers = false;
+	bool owns_events = false;
+	uint32_t classes = 0;
+	bool dispatched = false;
+	int priority;
 
 	wl_event_loop_dispatch_idle(loop);
 
-	count = epoll_wait(loop->epoll_fd, ep, ARRAY_LENGTH(ep), timeout);
+	size = ARRAY_LENGTH(stack_ep);
+	if (loop->max_events > 0 && loop->max_events < size)
+		size = loop->max_events;
+	if (loop->events && !loop->events_busy) {
+		ep = loop->events;
+		size = loop->events_size;
+		loop->events_busy = true;
+		owns_events = true;
+	}
+
+	if (!wl_list_empty(&loop->deferred_list))
+		timeout = 0;
+	else if (loop->has_dispatch_deadline)
+		timeout = wl_event_loop_deadline_timeout(loop, timeout);
+
+	count = epoll_wait(loop->epoll_fd, ep, size, timeout);
 	if (count < 0)
-		return -1;
+		goto err;
 
 	for (i = 0; i < count; i++) {
 		source = ep[i].data.ptr;
 		if (source == &loop->timers.base)
 			has_timers = true;
+		else
+			classes |= 1 << source->priority;
+		if (source->deferred)
+			wl_event_source_undefer(source);
 	}
 
 	if (has_timers) {
@@ -1018,15 +1360,55 @@ wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout)
 		 * (Note that timer sources also can't cancel pending non-timer
 		 * sources, since epoll_wait has already been called) */
 		if (wl_timer_heap_dispatch(&loop->timers) < 0)
-			return -1;
+			goto err;
 	}
 
-	for (i = 0; i < count; i++) {
-		source = ep[i].data.ptr;
-		if (source->fd != -1)
-			source->interface->dispatch(source, &ep[i]);
+	/* Deferred sources were ready first, so they go first */
+	if (!wl_list_empty(&loop->deferred_list))
+		wl_event_loop_dispatch_deferred(loop);
+
+	/* Start at a different source every time, so that the same ones
+	 * don't always wait for all the others when many are ready. */
+	start = count ? loop->dispatch_start++ % count : 0;
+
+	if ((classes & (classes - 1)) == 0) {
+		/* Only one priority class is ready, dispatch in order. */
+		for (n = 0, i = start; n < count; n++, i = (i + 1) % count) {
+			source = ep[i].data.ptr;
+			if (source->fd != -1 &&
+			    wl_event_loop_may_dispatch(loop, source))
+				source->interface->dispatch(source, &ep[i]);
+		}
+	} else {
+		for (priority = WL_EVENT_PRIORITY_INPUT;
+		     priority <= WL_EVENT_PRIORITY_BACKGROUND; priority++) {
+			if (!(classes & (1 << priority)))
+				continue;
+
+			/* Sources left undispatched are still ready and
+			 * will be returned by the next epoll_wait(). */
+			if (dispatched &&
+			    wl_event_loop_deadline_passed(loop, priority))
+				break;
+			dispatched = true;
+
+			for (n = 0, i = start; n < count;
+			     n++, i = (i + 1) % count) {
+				source = ep[i].data.ptr;
+				if (source->fd != -1 &&
+				    source != &loop->timers.base &&
+				    source->priority == (enum wl_event_priority) priority &&
+				    wl_event_loop_may_dispatch(loop, source))
+					source->interface->dispatch(source,
+								    &ep[i]);
+			}
+		}
 	}
 
+	if (owns_events)
+		loop->events_busy = false;
+	wl_event_loop_adapt_events(loop, count, size);
+
 	wl_event_loop_process_destroy_list(loop);
 
 	wl_event_loop_dispatch_idle(loop);
@@ -1034,6 +1416,65 @@ wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout)
 	while (post_dispatch_check(loop));
 
 	return 0;
+
+err:
+	if (owns_events)
+		loop->events_busy = false;
+
+	return -1;
+}
+
+/** Wait for events and dispatch them, stopping at a deadline
+ *
+ * \param loop The event loop whose sources to wait for.
+ * \param timeout The polling timeout in milliseconds.
+ * \param deadline Absolute CLOCK_MONOTONIC time to stop dispatching client
+ * traffic at, or NULL for no deadline.
+ * \return 0 for success, -1 for polling (or timer update) error.
+ *
+ * This works like wl_event_loop_dispatch(), except that it does not wait
+ * past \a deadline, and once the deadline has passed, no further sources
+ * of the WL_EVENT_PRIORITY_CLIENT or WL_EVENT_PRIORITY_BACKGROUND classes
+ * are dispatched. Client connections also stop handling requests at that
+ * point. Whatever is left is dispatched by the next
+ * wl_event_loop_dispatch() or wl_event_loop_dispatch_until() call, which
+ * does not block if there is any.
+ *
+ * Timers, sources of the input and display classes, idle sources and
+ * post-dispatch checks are not affected. To guarantee progress, the
+ * first client class source is dispatched and handles at least one
+ * request even if the deadline has already passed.
+ *
+ * A compositor that must start rendering at a fixed time before vblank
+ * can pass that time as \a deadline, so that heavy client traffic does
+ * not delay the repaint.
+ *
+ * \sa wl_event_source_set_priority()
+ * \memberof wl_event_loop
+ */
+WL_EXPORT int
+wl_event_loop_dispatch_until(struct wl_event_loop *loop, int timeout,
+			     const struct timespec *deadline)
+{
+	bool had_deadline = loop->has_dispatch_deadline;
+	struct timespec previous = loop->dispatch_deadline;
+	int ret;
+
+	if (deadline == NULL)
+		return wl_event_loop_dispatch(loop, timeout);
+
+	loop->has_dispatch_deadline = true;
+	loop->dispatch_deadline_passed = false;
+	loop->dispatched_client = false;
+	loop->dispatch_deadline = *deadline;
+
+	ret = wl_event_loop_dispatch(loop, timeout);
+
+	loop->has_dispatch_deadline = had_deadline;
+	loop->dispatch_deadline_passed = false;
+	loop->dispatch_deadline = previous;
+
+	return ret;
 }
 
 /** Get the event loop file descriptor
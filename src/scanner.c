@@ -84,7 +84,9 @@ usage(int ret)
 			"                                 that is e.g. wayland-client-core.h instead\n"
 			"                                 of wayland-client.h.\n"
 			"    -s,  --strict                exit immediately with an error if DTD\n"
-			"                                 verification fails.\n");
+			"                                 verification fails.\n"
+			"    -w,  --wire-views            also emit wire view accessors and view\n"
+			"                                 interfaces in server headers.\n");
 	exit(ret);
 }
 
@@ -168,6 +170,7 @@ struct protocol {
 	char *copyright;
 	struct description *description;
 	bool core_headers;
+	bool wire_views;
 };
 
 struct interface {
@@ -1503,6 +1506,124 @@ emit_structs(struct wl_list *message_list, struct interface *interface, enum sid
 	}
 }
 
+static void
+emit_view_accessor(struct interface *interface, struct message *message,
+		   const char *name, const char *suffix, const char *type,
+		   const char *getter, const char *cast, int index)
+{
+	printf("/**\n"
+	       " * @ingroup iface_%s\n"
+	       " */\n", interface->name);
+	printf("static inline %s\n"
+	       "%s_%s_view_get_%s%s(const struct wl_message_view *view)\n"
+	       "{\n"
+	       "\treturn %swl_message_view_get_%s(view, %d);\n"
+	       "}\n\n",
+	       type, interface->name, message->name, name, suffix,
+	       cast, getter, index);
+}
+
+static void
+emit_views(struct wl_list *message_list, struct interface *interface)
+{
+	struct message *m;
+	struct arg *a;
+	int index, n;
+
+	if (wl_list_empty(message_list))
+		return;
+
+	wl_list_for_each(m, message_list, link) {
+		index = 0;
+		wl_list_for_each(a, &m->arg_list, link) {
+			switch (a->type) {
+			case INT:
+				emit_view_accessor(interface, m, a->name, "",
+						   "int32_t", "int", "", index);
+				break;
+			case UNSIGNED:
+				emit_view_accessor(interface, m, a->name, "",
+						   "uint32_t", "uint", "", index);
+				break;
+			case FIXED:
+				emit_view_accessor(interface, m, a->name, "",
+						   "wl_fixed_t", "fixed", "",
+						   index);
+				break;
+			case STRING:
+				emit_view_accessor(interface, m, a->name, "",
+						   "const char *", "string", "",
+						   index);
+				break;
+			case OBJECT:
+				emit_view_accessor(interface, m, a->name, "",
+						   "struct wl_resource *",
+						   "object",
+						   "(struct wl_resource *) ",
+						   index);
+				break;
+			case NEW_ID:
+				if (a->interface_name == NULL) {
+					emit_view_accessor(interface, m,
+							   a->name,
+							   "_interface",
+							   "const char *",
+							   "string", "",
+							   index++);
+					emit_view_accessor(interface, m,
+							   a->name,
+							   "_version",
+							   "uint32_t", "uint",
+							   "", index++);
+				}
+				emit_view_accessor(interface, m, a->name, "",
+						   "uint32_t", "uint", "", index);
+				break;
+			case ARRAY:
+				emit_view_accessor(interface, m, a->name, "",
+						   "struct wl_array", "array",
+						   "", index);
+				break;
+			case FD:
+				emit_view_accessor(interface, m, a->name, "",
+						   "int32_t", "fd", "", index);
+				break;
+			}
+			index++;
+		}
+	}
+
+	printf("/**\n");
+	printf(" * @ingroup iface_%s\n", interface->name);
+	printf(" * @struct %s_view_interface\n", interface->name);
+	printf(" */\n");
+	printf("struct %s_view_interface {\n", interface->name);
+
+	wl_list_for_each(m, message_list, link) {
+		printf("\t/**\n");
+		if (m->description && m->description->summary)
+			printf("\t * %s\n", m->description->summary);
+		if (!wl_list_empty(&m->arg_list)) {
+			if (m->description && m->description->summary)
+				printf("\t *\n");
+			printf("\t * Arguments are read with the "
+			       "%s_%s_view_get_*() accessors.\n",
+			       interface->name, m->name);
+		}
+		if (m->since > 1)
+			printf("\t * @since %d\n", m->since);
+		printf("\t */\n");
+
+		n = strlen(m->name) + 17;
+		printf("\tvoid (*%s)(struct wl_client *client,\n"
+		       "%sstruct wl_resource *resource,\n"
+		       "%sconst struct wl_message_view *view);\n",
+		       m->name, indent(n), indent(n));
+	}
+
+	printf("};\n\n");
+}
+
 static void
 emit_types_forward_declarations(struct protocol *protocol,
 				struct wl_list *message_list,
@@ -1681,6 +1802,8 @@ emit_header(struct protocol *protocol, enum side side)
 
 		if (side == SERVER) {
 			emit_structs(&i->request_list, i, side);
+			if (protocol->wire_views)
+				emit_views(&i->request_list, i);
 			emit_opcodes(&i->event_list, i);
 			emit_opcode_versions(&i->event_list, i);
 			emit_opcode_versions(&i->request_list, i);
@@ -1918,6 +2041,7 @@ int main(int argc, char *argv[])
 	bool core_headers = false;
 	bool version = false;
 	bool strict = false;
+	bool wire_views = false;
 	bool fail = false;
 	int opt;
 	enum {
@@ -1933,11 +2057,12 @@ int main(int argc, char *argv[])
 		{ "version",           no_argument, NULL, 'v' },
 		{ "include-core-only", no_argument, NULL, 'c' },
 		{ "strict",            no_argument, NULL, 's' },
+		{ "wire-views",        no_argument, NULL, 'w' },
 		{ 0,                   0,           NULL, 0 }
 	};
 
 	while (1) {
-		opt = getopt_long(argc, argv, "hvcs", options, NULL);
+		opt = getopt_long(argc, argv, "hvcsw", options, NULL);
 
 		if (opt == -1)
 			break;
@@ -1955,6 +2080,9 @@ int main(int argc, char *argv[])
 		case 's':
 			strict = true;
 			break;
+		case 'w':
+			wire_views = true;
+			break;
 		default:
 			fail = true;
 			break;
@@ -2005,6 +2133,7 @@ int main(int argc, char *argv[])
 	memset(&protocol, 0, sizeof protocol);
 	wl_list_init(&protocol.interface_list);
 	protocol.core_headers = core_headers;
+	protocol.wire_views = wire_views;
 
 	/* initialize context */
 	memset(&ctx, 0, sizeof ctx);
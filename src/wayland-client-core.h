@@ -27,6 +27,7 @@
 #define WAYLAND_CLIENT_CORE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "wayland-util.h"
 #include "wayland-version.h"
 
@@ -124,6 +125,34 @@ struct wl_event_queue;
  */
 #define WL_MARSHAL_FLAG_DESTROY (1 << 0)
 
+/** An event delivered to a batch listener
+ *
+ * \sa wl_proxy_add_batch_listener()
+ * @ingroup wl_proxy
+ */
+struct wl_proxy_event {
+	/** Opcode of the event */
+	uint32_t opcode;
+	/** Description of the event */
+	const struct wl_message *message;
+	/** Arguments of the event; object arguments are \ref wl_proxy */
+	union wl_argument *args;
+};
+
+/** Batch listener function type
+ *
+ * \param data The user data of the proxy
+ * \param proxy The proxy the events were sent to
+ * \param events The events, in the order they were received
+ * \param count The number of events
+ *
+ * \sa wl_proxy_add_batch_listener()
+ * @ingroup wl_proxy
+ */
+typedef void (*wl_proxy_batch_func_t)(void *data, struct wl_proxy *proxy,
+				      const struct wl_proxy_event *events,
+				      uint32_t count);
+
 void
 wl_event_queue_destroy(struct wl_event_queue *queue);
 
@@ -197,6 +226,10 @@ wl_proxy_add_dispatcher(struct wl_proxy *proxy,
 			wl_dispatcher_func_t dispatcher_func,
 			const void * dispatcher_data, void *data);
 
+int
+wl_proxy_add_batch_listener(struct wl_proxy *proxy,
+			    wl_proxy_batch_func_t batch, void *data);
+
 void
 wl_proxy_set_user_data(struct wl_proxy *proxy, void *user_data);
 
@@ -209,6 +242,36 @@ wl_proxy_get_version(struct wl_proxy *proxy);
 uint32_t
 wl_proxy_get_id(struct wl_proxy *proxy);
 
+#ifdef WL_INLINE_FAST_PATHS
+/* The start of the private struct wl_proxy, kept stable so that these
+ * inline accessors keep working with newer libraries. */
+struct wl_proxy_inline_head {
+	struct {
+		const struct wl_interface *interface;
+		const void *implementation;
+		uint32_t id;
+	} object;
+	uint32_t flags;
+	int refcount;
+	void *user_data;
+};
+
+static inline void *
+wl_proxy_get_user_data_inline(struct wl_proxy *proxy)
+{
+	return ((struct wl_proxy_inline_head *) proxy)->user_data;
+}
+
+static inline uint32_t
+wl_proxy_get_id_inline(struct wl_proxy *proxy)
+{
+	return ((struct wl_proxy_inline_head *) proxy)->object.id;
+}
+
+#define wl_proxy_get_user_data(proxy) wl_proxy_get_user_data_inline(proxy)
+#define wl_proxy_get_id(proxy) wl_proxy_get_id_inline(proxy)
+#endif /* WL_INLINE_FAST_PATHS */
+
 void
 wl_proxy_set_tag(struct wl_proxy *proxy,
 		 const char * const *tag);
@@ -259,6 +322,48 @@ wl_display_get_protocol_error(struct wl_display *display,
 int
 wl_display_flush(struct wl_display *display);
 
+void
+wl_display_set_max_overflow_size(struct wl_display *display, size_t max_size);
+
+size_t
+wl_display_get_overflow_size(struct wl_display *display);
+
+int
+wl_display_set_socket_buffer_range(struct wl_display *display,
+				   size_t min_size, size_t max_size);
+
+int
+wl_display_get_socket_buffer_stats(struct wl_display *display,
+				   struct wl_socket_buffer_stats *stats);
+
+/** Lock contention statistics of a wl_display
+ *
+ * \sa wl_display_set_stats_enabled(), wl_display_get_stats()
+ */
+struct wl_display_stats {
+	/** Number of times the display lock was taken */
+	uint64_t lock_acquisitions;
+	/** Number of times the lock was held by another thread */
+	uint64_t lock_contended;
+	/** Total time spent waiting for the lock, in nanoseconds */
+	uint64_t lock_wait_ns;
+	/** Number of times wl_display_read_events() waited for another
+	 * thread to read */
+	uint64_t read_waits;
+	/** Total time spent in those waits, in nanoseconds */
+	uint64_t read_wait_ns;
+};
+
+void
+wl_display_set_stats_enabled(struct wl_display *display, bool enabled);
+
+void
+wl_display_get_stats(struct wl_display *display,
+		     struct wl_display_stats *stats);
+
+void
+wl_display_reset_stats(struct wl_display *display);
+
 int
 wl_display_roundtrip_queue(struct wl_display *display,
 			   struct wl_event_queue *queue);
@@ -285,6 +390,9 @@ wl_display_read_events(struct wl_display *display);
 void
 wl_log_set_handler_client(wl_log_func_t handler);
 
+void
+wl_set_allocator_client(const struct wl_allocator *allocator);
+
 #ifdef  __cplusplus
 }
 #endif
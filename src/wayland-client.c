@@ -41,6 +41,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "wayland-util.h"
 #include "wayland-os.h"
@@ -61,13 +62,18 @@ struct wl_zombie {
 };
 
 struct wl_proxy {
+	/* Fields used to queue and dispatch every event fit in the
+	 * first 64 bytes on LP64; the rarely used ones go last. The
+	 * fields up to user_data are mirrored by struct
+	 * wl_proxy_inline_head and must not change. */
 	struct wl_object object;
-	struct wl_display *display;
-	struct wl_event_queue *queue;
 	uint32_t flags;
 	int refcount;
 	void *user_data;
 	wl_dispatcher_func_t dispatcher;
+	wl_proxy_batch_func_t batch;
+	struct wl_event_queue *queue;
+	struct wl_display *display;
 	uint32_t version;
 	const char * const *tag;
 	struct wl_list queue_link; /**< in struct wl_event_queue::proxy_list */
@@ -109,12 +115,54 @@ struct wl_display {
 	int reader_count;
 	uint32_t read_serial;
 	pthread_cond_t reader_cond;
+
+	/* Only updated with the mutex held */
+	bool stats_enabled;
+	struct wl_display_stats stats;
 };
 
 /** \endcond */
 
 static int debug_client = 0;
 
+/* Requests that do not fit in the socket are held in the connection's
+ * overflow queue up to this many bytes, before the display fails with
+ * EAGAIN. */
+#define DEFAULT_MAX_OVERFLOW (1024 * 1024)
+
+static uint64_t
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000 +
+		end->tv_nsec - start->tv_nsec;
+}
+
+/* Lock the display mutex, accounting for contention when stats are on.
+ * The clock is only read when the mutex is already taken. Whether stats
+ * are on can only be known once it is held, and the thread is about to
+ * block anyway. */
+static void
+display_lock(struct wl_display *display)
+{
+	struct timespec start, end;
+
+	if (pthread_mutex_trylock(&display->mutex) == 0) {
+		if (display->stats_enabled)
+			display->stats.lock_acquisitions++;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(&display->mutex);
+
+	if (display->stats_enabled) {
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		display->stats.lock_acquisitions++;
+		display->stats.lock_contended++;
+		display->stats.lock_wait_ns += elapsed_ns(&start, &end);
+	}
+}
+
 /**
  * This helper function wakes up all threads that are
  * waiting for display->reader_cond (i. e. when reading is done,
@@ -198,7 +246,7 @@ display_protocol_error(struct wl_display *display, uint32_t code,
 		err = EPROTO;
 	}
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	display->last_error = err;
 
@@ -237,7 +285,7 @@ wl_proxy_unref(struct wl_proxy *proxy)
 	/* If we get here, the client must have explicitly requested
 	 * deletion. */
 	assert(proxy->flags & WL_PROXY_FLAG_DESTROYED);
-	free(proxy);
+	wl_free(proxy);
 }
 
 static void
@@ -348,9 +396,9 @@ wl_event_queue_destroy(struct wl_event_queue *queue)
 {
 	struct wl_display *display = queue->display;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 	wl_event_queue_release(queue);
-	free(queue);
+	wl_free(queue);
 	pthread_mutex_unlock(&display->mutex);
 }
 
@@ -431,7 +479,7 @@ static enum wl_iterator_result
 free_zombies(void *element, void *data, uint32_t flags)
 {
 	if (flags & WL_MAP_ENTRY_ZOMBIE)
-		free(element);
+		wl_free(element);
 
 	return WL_ITERATOR_CONTINUE;
 }
@@ -453,9 +501,12 @@ proxy_create(struct wl_proxy *factory, const struct wl_interface *interface,
 	proxy->refcount = 1;
 	proxy->version = version;
 
-	proxy->object.id = wl_map_insert_new(&display->objects, 0, proxy);
+	/* Objects are mostly used along with their factory, so keep them
+	 * close in the map. */
+	proxy->object.id = wl_map_insert_near(&display->objects, 0, proxy,
+					      factory->object.id);
 	if (proxy->object.id == 0) {
-		free(proxy);
+		wl_free(proxy);
 		return NULL;
 	}
 
@@ -489,7 +540,7 @@ wl_proxy_create(struct wl_proxy *factory, const struct wl_interface *interface)
 	struct wl_display *display = factory->display;
 	struct wl_proxy *proxy;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 	proxy = proxy_create(factory, interface, factory->version);
 	pthread_mutex_unlock(&display->mutex);
 
@@ -516,7 +567,7 @@ wl_proxy_create_for_id(struct wl_proxy *factory,
 	proxy->version = factory->version;
 
 	if (wl_map_insert_at(&display->objects, 0, id, proxy) == -1) {
-		free(proxy);
+		wl_free(proxy);
 		return NULL;
 	}
 
@@ -580,7 +631,7 @@ wl_proxy_destroy(struct wl_proxy *proxy)
 {
 	struct wl_display *display = proxy->display;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	wl_proxy_destroy_caller_locks(proxy);
 
@@ -613,7 +664,8 @@ wl_proxy_add_listener(struct wl_proxy *proxy,
 	if (proxy->flags & WL_PROXY_FLAG_WRAPPER)
 		wl_abort("Proxy %p is a wrapper\n", proxy);
 
-	if (proxy->object.implementation || proxy->dispatcher) {
+	if (proxy->object.implementation || proxy->dispatcher ||
+	    proxy->batch) {
 		wl_log("proxy %p already has listener\n", proxy);
 		return -1;
 	}
@@ -671,7 +723,8 @@ wl_proxy_add_dispatcher(struct wl_proxy *proxy,
 	if (proxy->flags & WL_PROXY_FLAG_WRAPPER)
 		wl_abort("Proxy %p is a wrapper\n", proxy);
 
-	if (proxy->object.implementation || proxy->dispatcher) {
+	if (proxy->object.implementation || proxy->dispatcher ||
+	    proxy->batch) {
 		wl_log("proxy %p already has listener\n", proxy);
 		return -1;
 	}
@@ -683,6 +736,49 @@ wl_proxy_add_dispatcher(struct wl_proxy *proxy,
 	return 0;
 }
 
+/** Set a proxy's batch listener
+ *
+ * \param proxy The proxy object
+ * \param batch The function to receive batches of events
+ * \param data User data to be associated with the proxy
+ * \return 0 on success or -1 on failure
+ *
+ * Set proxy's listener to \c batch and its user data to \c data. If a
+ * listener has already been set, this function fails and nothing is
+ * changed.
+ *
+ * Instead of one call per event, \c batch is called once for a run of
+ * consecutive events for \c proxy at the head of its event queue, with
+ * the display lock released only once for the whole run. This suits
+ * objects receiving many events per frame, such as touch or tablet
+ * devices.
+ *
+ * The events and their arguments are only valid until \c batch returns.
+ * File descriptors received in the events are owned by the listener.
+ *
+ * \c proxy must not be a proxy wrapper.
+ *
+ * \memberof wl_proxy
+ */
+WL_EXPORT int
+wl_proxy_add_batch_listener(struct wl_proxy *proxy,
+			    wl_proxy_batch_func_t batch, void *data)
+{
+	if (proxy->flags & WL_PROXY_FLAG_WRAPPER)
+		wl_abort("Proxy %p is a wrapper\n", proxy);
+
+	if (proxy->object.implementation || proxy->dispatcher ||
+	    proxy->batch) {
+		wl_log("proxy %p already has listener\n", proxy);
+		return -1;
+	}
+
+	proxy->batch = batch;
+	proxy->user_data = data;
+
+	return 0;
+}
+
 static struct wl_proxy *
 create_outgoing_proxy(struct wl_proxy *proxy, const struct wl_message *message,
 		      union wl_argument *args,
@@ -863,7 +959,7 @@ wl_proxy_marshal_array_flags(struct wl_proxy *proxy, uint32_t opcode,
 	const struct wl_message *message;
 	struct wl_display *disp = proxy->display;
 
-	pthread_mutex_lock(&disp->mutex);
+	display_lock(disp);
 
 	message = &proxy->object.interface->methods[opcode];
 	if (interface) {
@@ -1068,14 +1164,14 @@ display_handle_delete_id(void *data, struct wl_display *display, uint32_t id)
 {
 	struct wl_proxy *proxy;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	proxy = wl_map_lookup(&display->objects, id);
 
 	if (wl_object_is_zombie(&display->objects, id)) {
 		/* For zombie objects, the 'proxy' is actually the zombie
 		 * event-information structure, which we can free. */
-		free(proxy);
+		wl_free(proxy);
 		wl_map_remove(&display->objects, id);
 	} else if (proxy) {
 		proxy->flags |= WL_PROXY_FLAG_ID_DELETED;
@@ -1234,6 +1330,9 @@ wl_display_connect_to_fd(int fd)
 	if (display->connection == NULL)
 		goto err_connection;
 
+	wl_connection_set_max_overflow(display->connection,
+				       DEFAULT_MAX_OVERFLOW);
+
 	return display;
 
  err_connection:
@@ -1241,7 +1340,7 @@ wl_display_connect_to_fd(int fd)
 	pthread_cond_destroy(&display->reader_cond);
 	wl_map_release(&display->objects);
 	close(display->fd);
-	free(display);
+	wl_free(display);
 
 	return NULL;
 }
@@ -1326,7 +1425,7 @@ wl_display_disconnect(struct wl_display *display)
 	pthread_cond_destroy(&display->reader_cond);
 	close(display->fd);
 
-	free(display);
+	wl_free(display);
 }
 
 /** Get a display context's file descriptor
@@ -1337,6 +1436,10 @@ wl_display_disconnect(struct wl_display *display)
  * Return the file descriptor associated with a display so it can be
  * integrated into the client's main loop.
  *
+ * While wl_display_flush() fails with EAGAIN, the client should poll
+ * this file descriptor for POLLOUT and flush again once it becomes
+ * writable.
+ *
  * \memberof wl_display
  */
 WL_EXPORT int
@@ -1592,7 +1695,66 @@ id_from_object(union wl_argument *arg)
 	return 0;
 }
 
-static void
+/* Upper bound on the number of events handed to a batch listener in
+ * one call */
+#define MAX_BATCH_EVENTS 64
+
+/* Delivers the run of queued events for proxy starting with closure to
+ * its batch listener. Called with the display lock held, which is
+ * dropped once around the call. Returns the number of events
+ * delivered. */
+static int
+dispatch_batch(struct wl_display *display, struct wl_event_queue *queue,
+	       struct wl_proxy *proxy, struct wl_closure *closure)
+{
+	struct wl_closure *closures[MAX_BATCH_EVENTS];
+	struct wl_proxy_event events[MAX_BATCH_EVENTS];
+	int i, count = 0;
+
+	while (true) {
+		closures[count] = closure;
+		events[count].opcode = closure->opcode;
+		events[count].message = closure->message;
+		events[count].args = closure->args;
+		count++;
+
+		if (count == MAX_BATCH_EVENTS ||
+		    wl_list_empty(&queue->event_list))
+			break;
+
+		closure = wl_container_of(queue->event_list.next,
+					  closure, link);
+		if (closure->proxy != proxy)
+			break;
+
+		wl_list_remove(&closure->link);
+		validate_closure_objects(closure);
+	}
+
+	pthread_mutex_unlock(&display->mutex);
+
+	if (debug_client) {
+		for (i = 0; i < count; i++)
+			wl_closure_print(closures[i], &proxy->object,
+					 false, false, id_from_object);
+	}
+
+	proxy->batch(proxy->user_data, proxy, events, count);
+
+	display_lock(display);
+
+	for (i = 0; i < count; i++) {
+		wl_closure_clear_fds(closures[i]);
+		destroy_queued_closure(closures[i]);
+	}
+
+	return count;
+}
+
+/* Dispatches the event at the head of queue, along with the events
+ * following it when they go to the same batch listener. Returns the
+ * number of events dispatched. */
+static int
 dispatch_event(struct wl_display *display, struct wl_event_queue *queue)
 {
 	struct wl_closure *closure;
@@ -1613,9 +1775,12 @@ dispatch_event(struct wl_display *display, struct wl_event_queue *queue)
 		if (debug_client)
 			wl_closure_print(closure, &proxy->object, false, true, id_from_object);
 		destroy_queued_closure(closure);
-		return;
+		return 1;
 	}
 
+	if (proxy->batch)
+		return dispatch_batch(display, queue, proxy, closure);
+
 	pthread_mutex_unlock(&display->mutex);
 
 	if (proxy->dispatcher) {
@@ -1632,16 +1797,20 @@ dispatch_event(struct wl_display *display, struct wl_event_queue *queue)
 				  &proxy->object, opcode, proxy->user_data);
 	}
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	destroy_queued_closure(closure);
+
+	return 1;
 }
 
 static int
 read_events(struct wl_display *display)
 {
+	struct timespec start, end;
 	int total, rem, size;
 	uint32_t serial;
+	bool timed;
 
 	display->reader_count--;
 	if (display->reader_count == 0) {
@@ -1678,11 +1847,21 @@ read_events(struct wl_display *display)
 
 		display_wakeup_threads(display);
 	} else {
+		timed = display->stats_enabled;
+		if (timed)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
 		serial = display->read_serial;
 		while (display->read_serial == serial)
 			pthread_cond_wait(&display->reader_cond,
 					  &display->mutex);
 
+		if (timed && display->stats_enabled) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			display->stats.read_waits++;
+			display->stats.read_wait_ns += elapsed_ns(&start, &end);
+		}
+
 		if (display->last_error) {
 			errno = display->last_error;
 			return -1;
@@ -1740,7 +1919,7 @@ wl_display_read_events(struct wl_display *display)
 {
 	int ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	if (display->last_error) {
 		cancel_read(display);
@@ -1767,17 +1946,15 @@ dispatch_queue(struct wl_display *display, struct wl_event_queue *queue)
 
 	count = 0;
 	while (!wl_list_empty(&display->display_queue.event_list)) {
-		dispatch_event(display, &display->display_queue);
+		count += dispatch_event(display, &display->display_queue);
 		if (display->last_error)
 			goto err;
-		count++;
 	}
 
 	while (!wl_list_empty(&queue->event_list)) {
-		dispatch_event(display, queue);
+		count += dispatch_event(display, queue);
 		if (display->last_error)
 			goto err;
-		count++;
 	}
 
 	return count;
@@ -1848,7 +2025,7 @@ wl_display_prepare_read_queue(struct wl_display *display,
 {
 	int ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	if (!wl_list_empty(&queue->event_list)) {
 		errno = EAGAIN;
@@ -1895,7 +2072,7 @@ wl_display_prepare_read(struct wl_display *display)
 WL_EXPORT void
 wl_display_cancel_read(struct wl_display *display)
 {
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	cancel_read(display);
 
@@ -2014,7 +2191,7 @@ wl_display_dispatch_queue_pending(struct wl_display *display,
 {
 	int ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	ret = dispatch_queue(display, queue);
 
@@ -2101,7 +2278,7 @@ wl_display_get_error(struct wl_display *display)
 {
 	int ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	ret = display->last_error;
 
@@ -2140,7 +2317,7 @@ wl_display_get_protocol_error(struct wl_display *display,
 {
 	uint32_t ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	ret = display->protocol_error.code;
 
@@ -2170,6 +2347,10 @@ wl_display_get_protocol_error(struct wl_display *display,
  * to EAGAIN and -1 returned.  In that case, use poll on the display
  * file descriptor to wait for it to become writable again.
  *
+ * Requests sent while the socket is full are held in an overflow queue
+ * until a later flush can write them, see
+ * wl_display_set_max_overflow_size().
+ *
  * \memberof wl_display
  */
 WL_EXPORT int
@@ -2177,7 +2358,7 @@ wl_display_flush(struct wl_display *display)
 {
 	int ret;
 
-	pthread_mutex_lock(&display->mutex);
+	display_lock(display);
 
 	if (display->last_error) {
 		errno = display->last_error;
@@ -2197,6 +2378,190 @@ wl_display_flush(struct wl_display *display)
 	return ret;
 }
 
+/** Set the maximum size of the outgoing overflow queue
+ *
+ * \param display The display context object
+ * \param max_size The maximum number of bytes to hold, or 0 to disable
+ * the overflow queue
+ *
+ * When the compositor does not read requests as fast as the client sends
+ * them, the socket fills up. Requests that do not fit are then appended
+ * to an overflow queue, which grows up to \c max_size bytes and is
+ * written out by wl_display_flush() as the socket drains. Only once the
+ * overflow queue is full does sending a request fail, which is a fatal
+ * display error with errno set to EAGAIN.
+ *
+ * The default maximum size is 1 MiB.
+ *
+ * \sa wl_display_get_overflow_size(), wl_display_flush()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_set_max_overflow_size(struct wl_display *display, size_t max_size)
+{
+	display_lock(display);
+
+	wl_connection_set_max_overflow(display->connection, max_size);
+
+	pthread_mutex_unlock(&display->mutex);
+}
+
+/** Get the current size of the outgoing overflow queue
+ *
+ * \param display The display context object
+ * \return The number of bytes held in the overflow queue
+ *
+ * A non-zero size means the compositor is not keeping up with the
+ * client's requests. The queue is drained by wl_display_flush().
+ *
+ * \sa wl_display_set_max_overflow_size()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT size_t
+wl_display_get_overflow_size(struct wl_display *display)
+{
+	size_t size;
+
+	display_lock(display);
+
+	size = wl_connection_overflow_size(display->connection);
+
+	pthread_mutex_unlock(&display->mutex);
+
+	return size;
+}
+
+/** Adapt the socket send buffer to the client's bursts of requests
+ *
+ * \param display The display context object
+ * \param min_size The smallest send buffer to use
+ * \param max_size The largest send buffer to use, or 0 to stop adapting
+ * \return 0 on success, -1 on failure with errno set
+ *
+ * By default, the send buffer of the socket keeps the size the kernel
+ * gave it. With a range set, it is doubled, up to \c max_size, whenever
+ * a flush would fail with EAGAIN. About once a second, checked when the
+ * display is flushed or events are read, it is shrunk back towards
+ * twice the most data seen queued in the socket since, down to
+ * \c min_size. This keeps bursts from filling the socket while idle
+ * connections hold little kernel memory.
+ *
+ * Sizes are as reported by getsockopt() for SO_SNDBUF, and growing the
+ * buffer past the system wide limit has no effect. Fails with EINVAL if
+ * \c min_size is 0 or larger than \c max_size.
+ *
+ * \sa wl_display_get_socket_buffer_stats()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_set_socket_buffer_range(struct wl_display *display,
+				   size_t min_size, size_t max_size)
+{
+	int ret;
+
+	display_lock(display);
+
+	ret = wl_connection_set_sndbuf_range(display->connection,
+					     min_size, max_size);
+
+	pthread_mutex_unlock(&display->mutex);
+
+	return ret;
+}
+
+/** Get the counters of the adaptive socket send buffer
+ *
+ * \param display The display context object
+ * \param stats Where to store the counters
+ * \return 0 on success, -1 with errno set to ENOTSUP if adaptive sizing
+ * is not enabled
+ *
+ * \sa wl_display_set_socket_buffer_range()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_get_socket_buffer_stats(struct wl_display *display,
+				   struct wl_socket_buffer_stats *stats)
+{
+	int ret;
+
+	display_lock(display);
+
+	ret = wl_connection_get_sndbuf_stats(display->connection, stats);
+
+	pthread_mutex_unlock(&display->mutex);
+
+	return ret;
+}
+
+/** Enable or disable lock contention statistics
+ *
+ * \param display The display context object
+ * \param enabled Whether to collect statistics
+ *
+ * When enabled, the display counts how often its internal lock is taken
+ * and how long threads wait for it when another thread holds it, as
+ * well as how often and how long wl_display_read_events() blocks while
+ * another thread reads from the display fd. The counters can be
+ * retrieved with wl_display_get_stats().
+ *
+ * Statistics are disabled by default. Disabling them keeps the current
+ * counters; use wl_display_reset_stats() to clear them.
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_set_stats_enabled(struct wl_display *display, bool enabled)
+{
+	display_lock(display);
+
+	display->stats_enabled = enabled;
+
+	pthread_mutex_unlock(&display->mutex);
+}
+
+/** Retrieve lock contention statistics
+ *
+ * \param display The display context object
+ * \param stats Where to store the counters
+ *
+ * \sa wl_display_set_stats_enabled(), wl_display_reset_stats()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_get_stats(struct wl_display *display,
+		     struct wl_display_stats *stats)
+{
+	display_lock(display);
+
+	*stats = display->stats;
+
+	pthread_mutex_unlock(&display->mutex);
+}
+
+/** Clear lock contention statistics
+ *
+ * \param display The display context object
+ *
+ * \sa wl_display_get_stats()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_reset_stats(struct wl_display *display)
+{
+	display_lock(display);
+
+	memset(&display->stats, 0, sizeof display->stats);
+
+	pthread_mutex_unlock(&display->mutex);
+}
+
 /** Set the user data associated with a proxy
  *
  * \param proxy The proxy object
@@ -2369,7 +2734,7 @@ wl_proxy_get_class(struct wl_proxy *proxy)
 WL_EXPORT void
 wl_proxy_set_queue(struct wl_proxy *proxy, struct wl_event_queue *queue)
 {
-	pthread_mutex_lock(&proxy->display->mutex);
+	display_lock(proxy->display);
 
 	wl_list_remove(&proxy->queue_link);
 
@@ -2443,7 +2808,7 @@ wl_proxy_create_wrapper(void *proxy)
 	if (!wrapper)
 		return NULL;
 
-	pthread_mutex_lock(&wrapped_proxy->display->mutex);
+	display_lock(wrapped_proxy->display);
 
 	wrapper->object.interface = wrapped_proxy->object.interface;
 	wrapper->object.id = wrapped_proxy->object.id;
@@ -2476,13 +2841,13 @@ wl_proxy_wrapper_destroy(void *proxy_wrapper)
 
 	assert(wrapper->refcount == 1);
 
-	pthread_mutex_lock(&wrapper->display->mutex);
+	display_lock(wrapper->display);
 
 	wl_list_remove(&wrapper->queue_link);
 
 	pthread_mutex_unlock(&wrapper->display->mutex);
 
-	free(wrapper);
+	wl_free(wrapper);
 }
 
 WL_EXPORT void
@@ -2490,3 +2855,18 @@ wl_log_set_handler_client(wl_log_func_t handler)
 {
 	wl_log_handler = handler;
 }
+
+/** Set the memory allocator of libwayland-client
+ *
+ * \param allocator The allocator to use, or NULL for the C library's
+ *
+ * Routes all memory libwayland-client allocates for itself through
+ * \c allocator, which is copied. As memory must be freed by the allocator
+ * that allocated it, this has to be called before the first display is
+ * connected, and not again while any display is still connected.
+ */
+WL_EXPORT void
+wl_set_allocator_client(const struct wl_allocator *allocator)
+{
+	wl_allocator_set(allocator);
+}
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #define WL_HIDE_DEPRECATED 1
 
@@ -47,6 +48,9 @@
 #define WL_SERVER_ID_START 0xff000000
 #define WL_MAP_MAX_OBJECTS 0x00f00000
 #define WL_CLOSURE_MAX_ARGS 20
+/* Size of a connection's ring buffers, and so the largest amount of
+ * data a single wl_connection_write() accepts */
+#define WL_CONNECTION_BUFFER_SIZE 4096
 
 struct wl_object {
 	const struct wl_interface *interface;
@@ -67,11 +71,26 @@ enum wl_map_entry_flags {
 	WL_MAP_ENTRY_ZOMBIE = (1 << 0) /* Client side only */
 };
 
+/* Number of slots in the wl_map lookup cache, must be a power of two */
+#define WL_MAP_CACHE_SIZE 4
+
+struct wl_map_cache_slot {
+	uint32_t id;
+	uintptr_t entry;
+};
+
 struct wl_map {
 	struct wl_array client_entries;
 	struct wl_array server_entries;
 	uint32_t side;
-	uint32_t free_list;
+	/* Free ids of the side this map allocates from: one bit per entry
+	 * in free_bits, set while the entry is free.  hint is the last id
+	 * handed out or given back and steers the next allocation. */
+	uint32_t free_count;
+	uint32_t hint;
+	struct wl_array free_bits;
+	/* Recently looked up entries, indexed by id */
+	struct wl_map_cache_slot cache[WL_MAP_CACHE_SIZE];
 };
 
 typedef enum wl_iterator_result (*wl_iterator_func_t)(void *element,
@@ -87,6 +106,10 @@ wl_map_release(struct wl_map *map);
 uint32_t
 wl_map_insert_new(struct wl_map *map, uint32_t flags, void *data);
 
+uint32_t
+wl_map_insert_near(struct wl_map *map, uint32_t flags, void *data,
+		   uint32_t near);
+
 int
 wl_map_insert_at(struct wl_map *map, uint32_t flags, uint32_t i, void *data);
 
@@ -105,6 +128,10 @@ wl_map_lookup_flags(struct wl_map *map, uint32_t i);
 void
 wl_map_for_each(struct wl_map *map, wl_iterator_func_t func, void *data);
 
+void
+wl_map_for_each_from(struct wl_map *map, uint32_t *next,
+		     wl_iterator_func_t func, void *data);
+
 struct wl_connection *
 wl_connection_create(int fd);
 
@@ -137,6 +164,27 @@ wl_connection_queue(struct wl_connection *connection,
 int
 wl_connection_get_fd(struct wl_connection *connection);
 
+bool
+wl_connection_is_mirrored(struct wl_connection *connection);
+
+void
+wl_connection_set_max_overflow(struct wl_connection *connection,
+			       size_t max_size);
+
+size_t
+wl_connection_overflow_size(struct wl_connection *connection);
+
+int
+wl_connection_set_sndbuf_range(struct wl_connection *connection,
+			       size_t min_size, size_t max_size);
+
+int
+wl_connection_get_sndbuf_stats(struct wl_connection *connection,
+			       struct wl_socket_buffer_stats *stats);
+
+int
+wl_connection_sndbuf_idle(struct wl_connection *connection);
+
 struct wl_closure {
 	int count;
 	const struct wl_message *message;
@@ -174,6 +222,15 @@ wl_closure_marshal(struct wl_object *sender,
 		    uint32_t opcode, union wl_argument *args,
 		    const struct wl_message *message);
 
+int
+wl_closure_marshal_in_place(struct wl_closure *closure,
+			    struct wl_object *sender, uint32_t opcode,
+			    union wl_argument *args,
+			    const struct wl_message *message);
+
+int
+wl_closure_close_fds(struct wl_closure *closure);
+
 struct wl_closure *
 wl_closure_vmarshal(struct wl_object *sender,
 		    uint32_t opcode, va_list ap,
@@ -200,6 +257,17 @@ void
 wl_closure_invoke(struct wl_closure *closure, uint32_t flags,
 		  struct wl_object *target, uint32_t opcode, void *data);
 
+void
+wl_closure_clear_fds(struct wl_closure *closure);
+
+int
+wl_connection_view(struct wl_connection *connection, uint32_t size,
+		   struct wl_map *objects, const struct wl_message *message,
+		   struct wl_message_view *view);
+
+void
+wl_closure_view(struct wl_closure *closure, struct wl_message_view *view);
+
 void
 wl_closure_dispatch(struct wl_closure *closure, wl_dispatcher_func_t dispatcher,
 		    struct wl_object *target, uint32_t opcode);
@@ -210,6 +278,13 @@ wl_closure_send(struct wl_closure *closure, struct wl_connection *connection);
 int
 wl_closure_queue(struct wl_closure *closure, struct wl_connection *connection);
 
+/* Most closures wl_closure_send_array() takes at once */
+#define WL_CLOSURE_BATCH_MAX 16
+
+int
+wl_closure_send_array(struct wl_closure *closures, int count,
+		      struct wl_connection *connection, bool flush);
+
 void
 wl_closure_print(struct wl_closure *closure,
 		 struct wl_object *target, int send, int discarded,
@@ -228,10 +303,68 @@ struct wl_display;
 struct wl_array *
 wl_display_get_additional_shm_formats(struct wl_display *display);
 
+bool
+wl_display_shm_format_is_supported(struct wl_display *display,
+				   uint32_t format);
+
+struct wl_resource;
+
+void
+wl_display_send_shm_formats(struct wl_display *display,
+			    struct wl_resource *resource);
+
+size_t
+wl_display_get_shm_lazy_threshold(struct wl_display *display);
+
+struct wl_event_loop;
+struct wl_event_source;
+
+bool
+wl_event_loop_out_of_time(struct wl_event_loop *loop);
+
+void
+wl_event_source_defer(struct wl_event_source *source);
+
+extern struct wl_allocator wl_allocator_active;
+
+void
+wl_allocator_set(const struct wl_allocator *allocator);
+
+static inline void *
+wl_malloc(size_t s)
+{
+	return wl_allocator_active.alloc(wl_allocator_active.data, s);
+}
+
+static inline void *
+wl_realloc(void *p, size_t s)
+{
+	return wl_allocator_active.realloc(wl_allocator_active.data, p, s);
+}
+
+static inline void
+wl_free(void *p)
+{
+	wl_allocator_active.free(wl_allocator_active.data, p);
+}
+
+/* wl_array_release() and wl_array_add() for arrays owned by the library,
+ * using its allocator */
+void
+wl_priv_array_release(struct wl_array *array);
+
+void *
+wl_priv_array_add(struct wl_array *array, size_t size);
+
 static inline void *
 zalloc(size_t s)
 {
-	return calloc(1, s);
+	void *p = wl_malloc(s);
+
+	if (p)
+		memset(p, 0, s);
+
+	return p;
 }
 
 void
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include "wayland-util.h"
 #include "wayland-version.h"
 
@@ -43,6 +44,26 @@ enum {
 	WL_EVENT_ERROR    = 0x08
 };
 
+/** Dispatch priority classes of event sources
+ *
+ * When several sources are ready in the same wl_event_loop_dispatch()
+ * call, they are dispatched in class order, from
+ * WL_EVENT_PRIORITY_INPUT to WL_EVENT_PRIORITY_BACKGROUND, and in the
+ * order they became ready within a class.
+ *
+ * \sa wl_event_source_set_priority() wl_event_loop_set_priority_deadline()
+ */
+enum wl_event_priority {
+	/** Input devices */
+	WL_EVENT_PRIORITY_INPUT = 0,
+	/** Display hardware, e.g. DRM page flip events */
+	WL_EVENT_PRIORITY_DISPLAY = 1,
+	/** Client connections; the default for all sources */
+	WL_EVENT_PRIORITY_CLIENT = 2,
+	/** Work that can wait */
+	WL_EVENT_PRIORITY_BACKGROUND = 3,
+};
+
 /** File descriptor dispatch function type
  *
  * Functions of this type are used as callbacks for file descriptor events.
@@ -158,12 +179,28 @@ wl_event_source_timer_update(struct wl_event_source *source,
 int
 wl_event_source_remove(struct wl_event_source *source);
 
+int
+wl_event_source_set_priority(struct wl_event_source *source,
+			     enum wl_event_priority priority);
+
+void
+wl_event_loop_set_priority_deadline(struct wl_event_loop *loop,
+				    enum wl_event_priority priority,
+				    const struct timespec *deadline);
+
+int
+wl_event_loop_set_max_events(struct wl_event_loop *loop, int max_events);
+
 void
 wl_event_source_check(struct wl_event_source *source);
 
 int
 wl_event_loop_dispatch(struct wl_event_loop *loop, int timeout);
 
+int
+wl_event_loop_dispatch_until(struct wl_event_loop *loop, int timeout,
+			     const struct timespec *deadline);
+
 void
 wl_event_loop_dispatch_idle(struct wl_event_loop *loop);
 
@@ -217,6 +254,14 @@ wl_display_flush_clients(struct wl_display *display);
 void
 wl_display_destroy_clients(struct wl_display *display);
 
+int
+wl_display_set_client_teardown_budget(struct wl_display *display,
+				      uint32_t budget);
+
+int
+wl_display_set_client_socket_buffer_range(struct wl_display *display,
+					  size_t min_size, size_t max_size);
+
 struct wl_client;
 
 typedef void (*wl_global_bind_func_t)(struct wl_client *client, void *data,
@@ -326,6 +371,10 @@ wl_client_get_credentials(struct wl_client *client,
 int
 wl_client_get_fd(struct wl_client *client);
 
+int
+wl_client_get_socket_buffer_stats(struct wl_client *client,
+				  struct wl_socket_buffer_stats *stats);
+
 void
 wl_client_add_destroy_listener(struct wl_client *client,
 			       struct wl_listener *listener);
@@ -365,6 +414,63 @@ wl_client_for_each_resource(struct wl_client *client,
                             wl_client_for_each_resource_iterator_func_t iterator,
                             void *user_data);
 
+/** Per-client resource quotas
+ *
+ * \sa wl_client_set_quota() wl_display_set_client_quota()
+ */
+enum wl_client_quota {
+	/** Live objects, counted by wl_resource_create() */
+	WL_CLIENT_QUOTA_OBJECTS = 0,
+	/** Requests dispatched per second */
+	WL_CLIENT_QUOTA_REQUEST_RATE = 1,
+	/** File descriptors held on behalf of the client */
+	WL_CLIENT_QUOTA_FDS = 2,
+	/** Bytes of shared memory pools created by the client */
+	WL_CLIENT_QUOTA_SHM_BYTES = 3,
+};
+
+/** What happens when a client goes over one of its quotas
+ *
+ * The quota handler set with wl_display_set_client_quota_handler() is
+ * called in every case.
+ */
+enum wl_client_quota_action {
+	/** Only call the quota handler */
+	WL_CLIENT_QUOTA_ACTION_NOTIFY = 0,
+	/** Stop dispatching the client's requests until the end of the
+	 * second, for WL_CLIENT_QUOTA_REQUEST_RATE only */
+	WL_CLIENT_QUOTA_ACTION_THROTTLE = 1,
+	/** Refuse the charge and disconnect the client */
+	WL_CLIENT_QUOTA_ACTION_DISCONNECT = 2,
+};
+
+typedef void (*wl_client_quota_func_t)(struct wl_client *client,
+				       enum wl_client_quota quota,
+				       uint64_t usage,
+				       void *data);
+
+int
+wl_display_set_client_quota(struct wl_display *display,
+			    enum wl_client_quota quota, uint64_t limit,
+			    enum wl_client_quota_action action);
+
+void
+wl_display_set_client_quota_handler(struct wl_display *display,
+				    wl_client_quota_func_t handler,
+				    void *data);
+
+int
+wl_client_set_quota(struct wl_client *client, enum wl_client_quota quota,
+		    uint64_t limit, enum wl_client_quota_action action);
+
+uint64_t
+wl_client_get_quota_usage(struct wl_client *client,
+			  enum wl_client_quota quota);
+
+int
+wl_client_quota_charge(struct wl_client *client, enum wl_client_quota quota,
+		       int64_t delta);
+
 /** \class wl_listener
  *
  * \brief A single listener for Wayland signals
@@ -533,6 +639,24 @@ void
 wl_resource_queue_event_array(struct wl_resource *resource,
 			      uint32_t opcode, union wl_argument *args);
 
+/** An event of a batch posted with wl_client_post_events() */
+struct wl_resource_event {
+	/** The resource sending the event */
+	struct wl_resource *resource;
+	/** The opcode of the event */
+	uint32_t opcode;
+	/** The arguments of the event */
+	union wl_argument *args;
+};
+
+void
+wl_client_post_events(struct wl_client *client,
+		      const struct wl_resource_event *events, size_t count);
+
+void
+wl_client_queue_events(struct wl_client *client,
+		       const struct wl_resource_event *events, size_t count);
+
 /* msg is a printf format string, variable args are its args. */
 void
 wl_resource_post_error(struct wl_resource *resource,
@@ -562,6 +686,40 @@ wl_resource_set_dispatcher(struct wl_resource *resource,
 			   void *data,
 			   wl_resource_destroy_func_t destroy);
 
+/** A request handler that reads its arguments from a wl_message_view
+ *
+ * \sa wl_resource_set_view_implementation
+ */
+typedef void (*wl_resource_view_func_t)(struct wl_client *client,
+					struct wl_resource *resource,
+					const struct wl_message_view *view);
+
+void
+wl_resource_set_view_implementation(struct wl_resource *resource,
+				    const void *implementation,
+				    void *data,
+				    wl_resource_destroy_func_t destroy);
+
+/** Batched request handler type
+ *
+ * \param client The client sending the requests
+ * \param resource The resource the requests were sent to
+ * \param opcode The opcode shared by all the requests
+ * \param args The arguments of each request, in the order they were sent
+ * \param count The number of requests, at least 1
+ *
+ * \sa wl_resource_set_batch_handler
+ */
+typedef void (*wl_resource_batch_func_t)(struct wl_client *client,
+					 struct wl_resource *resource,
+					 uint32_t opcode,
+					 union wl_argument **args,
+					 uint32_t count);
+
+int
+wl_resource_set_batch_handler(struct wl_resource *resource, uint64_t opcodes,
+			      wl_resource_batch_func_t batch);
+
 void
 wl_resource_destroy(struct wl_resource *resource);
 
@@ -589,6 +747,65 @@ wl_resource_get_user_data(struct wl_resource *resource);
 int
 wl_resource_get_version(struct wl_resource *resource);
 
+#ifdef WL_INLINE_FAST_PATHS
+/* The start of the private struct wl_resource, which cannot change as
+ * long as the deprecated public struct wl_resource is around. */
+struct wl_resource_inline_head {
+	struct {
+		const struct wl_interface *interface;
+		const void *implementation;
+		uint32_t id;
+	} object;
+	wl_resource_destroy_func_t destroy;
+	struct wl_list link;
+	struct wl_list deprecated_destroy_listeners;
+	struct wl_client *client;
+	void *data;
+};
+
+static inline uint32_t
+wl_resource_get_id_inline(struct wl_resource *resource)
+{
+	return ((struct wl_resource_inline_head *) resource)->object.id;
+}
+
+static inline struct wl_list *
+wl_resource_get_link_inline(struct wl_resource *resource)
+{
+	return &((struct wl_resource_inline_head *) resource)->link;
+}
+
+static inline struct wl_resource *
+wl_resource_from_link_inline(struct wl_list *link)
+{
+	struct wl_resource_inline_head *head;
+
+	head = wl_container_of(link, head, link);
+
+	return (struct wl_resource *) head;
+}
+
+static inline struct wl_client *
+wl_resource_get_client_inline(struct wl_resource *resource)
+{
+	return ((struct wl_resource_inline_head *) resource)->client;
+}
+
+static inline void *
+wl_resource_get_user_data_inline(struct wl_resource *resource)
+{
+	return ((struct wl_resource_inline_head *) resource)->data;
+}
+
+#define wl_resource_get_id(resource) wl_resource_get_id_inline(resource)
+#define wl_resource_get_link(resource) wl_resource_get_link_inline(resource)
+#define wl_resource_from_link(link) wl_resource_from_link_inline(link)
+#define wl_resource_get_client(resource) \
+	wl_resource_get_client_inline(resource)
+#define wl_resource_get_user_data(resource) \
+	wl_resource_get_user_data_inline(resource)
+#endif /* WL_INLINE_FAST_PATHS */
+
 void
 wl_resource_set_destructor(struct wl_resource *resource,
 			   wl_resource_destroy_func_t destroy);
@@ -608,6 +825,26 @@ struct wl_listener *
 wl_resource_get_destroy_listener(struct wl_resource *resource,
 				 wl_notify_func_t notify);
 
+/** Attachment destroy function type
+ *
+ * \param resource The resource being destroyed
+ * \param data The data attached to \a resource
+ *
+ * \sa wl_display_register_resource_attachment()
+ */
+typedef void (*wl_resource_attachment_destroy_func_t)(struct wl_resource *resource,
+						      void *data);
+
+int
+wl_display_register_resource_attachment(struct wl_display *display,
+					wl_resource_attachment_destroy_func_t destroy);
+
+int
+wl_resource_set_attachment(struct wl_resource *resource, int key, void *data);
+
+void *
+wl_resource_get_attachment(struct wl_resource *resource, int key);
+
 #define wl_resource_for_each(resource, list)					\
 	for (resource = 0, resource = wl_resource_from_link((list)->next);	\
 	     wl_resource_get_link(resource) != (list);				\
@@ -657,6 +894,10 @@ wl_display_init_shm(struct wl_display *display);
 uint32_t *
 wl_display_add_shm_format(struct wl_display *display, uint32_t format);
 
+void
+wl_display_set_shm_lazy_mapping(struct wl_display *display,
+				size_t min_pool_size);
+
 struct wl_shm_buffer *
 wl_shm_buffer_create(struct wl_client *client,
 		     uint32_t id, int32_t width, int32_t height,
@@ -665,6 +906,9 @@ wl_shm_buffer_create(struct wl_client *client,
 void
 wl_log_set_handler_server(wl_log_func_t handler);
 
+void
+wl_set_allocator_server(const struct wl_allocator *allocator);
+
 enum wl_protocol_logger_type {
 	WL_PROTOCOL_LOGGER_REQUEST,
 	WL_PROTOCOL_LOGGER_EVENT,
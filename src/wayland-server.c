@@ -33,6 +33,7 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -71,19 +72,41 @@ struct wl_socket {
 	char *display_name;
 };
 
+#define CLIENT_QUOTA_COUNT	(WL_CLIENT_QUOTA_SHM_BYTES + 1)
+
+struct client_quota {
+	uint64_t limit;
+	uint64_t usage;
+	enum wl_client_quota_action action;
+	/* The handler was called since usage last went over the limit */
+	bool notified;
+};
+
 struct wl_client {
+	/* Fields used for every request come first, so that they share
+	 * a cache line with the head of the object map. */
 	struct wl_connection *connection;
 	struct wl_event_source *source;
 	struct wl_display *display;
+	int error;
+	struct wl_map objects;
+
+	struct client_quota quotas[CLIENT_QUOTA_COUNT];
+	struct timespec rate_window_end;
+	bool throttled;
+	/* Events are queued that the socket did not take yet */
+	bool flush_pending;
+	struct wl_event_source *throttle_source;
+
 	struct wl_resource *display_resource;
 	struct wl_list link;
-	struct wl_map objects;
+	/* Id of the next object to destroy in an incremental teardown */
+	uint32_t teardown_next;
 	struct wl_priv_signal destroy_signal;
 	struct wl_priv_signal destroy_late_signal;
 	pid_t pid;
 	uid_t uid;
 	gid_t gid;
-	int error;
 	struct wl_priv_signal resource_created_signal;
 };
 
@@ -104,12 +127,37 @@ struct wl_display {
 	struct wl_priv_signal create_client_signal;
 
 	struct wl_array additional_shm_formats;
+	size_t shm_lazy_threshold;
+	/* Hash set of the additional shm formats and the wl_shm.format
+	 * events for all formats, built for additional_shm_formats as it
+	 * was when it had shm_formats_size bytes */
+	struct wl_array shm_format_table;
+	struct wl_array shm_format_events;
+	size_t shm_formats_size;
+	bool shm_formats_valid;
+
+	struct wl_array resource_attachments;
 
 	wl_display_global_filter_func_t global_filter;
 	void *global_filter_data;
 
 	int terminate_efd;
 	struct wl_event_source *term_source;
+
+	uint32_t teardown_budget;
+	struct wl_list teardown_list;
+	int teardown_efd;
+	struct wl_event_source *teardown_source;
+
+	size_t client_sndbuf_min, client_sndbuf_max;
+	/* Shrinks the send buffers of clients that went quiet */
+	struct wl_event_source *sndbuf_timer;
+	bool sndbuf_timer_armed;
+
+	/* Only limit and action are used, copied to new clients */
+	struct client_quota client_quotas[CLIENT_QUOTA_COUNT];
+	wl_client_quota_func_t quota_handler;
+	void *quota_handler_data;
 };
 
 struct wl_global {
@@ -130,13 +178,20 @@ struct wl_resource {
 	/* Unfortunately some users of libwayland (e.g. mesa) still use the
 	 * deprecated wl_resource struct, even if creating it with the new
 	 * wl_resource_create(). So we cannot change the layout of the struct
-	 * unless after the data field. */
+	 * unless after the data field. The same prefix is used by struct
+	 * wl_resource_inline_head. */
 	struct wl_signal deprecated_destroy_signal;
 	struct wl_client *client;
 	void *data;
+	/* Fields used for every request follow data directly; the
+	 * rarely used ones go last. */
 	int version;
+	bool views;
 	wl_dispatcher_func_t dispatcher;
+	wl_resource_batch_func_t batch;
+	uint64_t batch_opcodes;
 	struct wl_priv_signal destroy_signal;
+	struct wl_array attachments;
 };
 
 struct wl_protocol_logger {
@@ -267,6 +322,110 @@ wl_resource_queue_event_array(struct wl_resource *resource, uint32_t opcode,
 	handle_array(resource, opcode, args, wl_closure_queue);
 }
 
+static void
+handle_events(struct wl_client *client,
+	      const struct wl_resource_event *events, size_t count,
+	      bool flush)
+{
+	struct wl_closure closures[WL_CLOSURE_BATCH_MAX];
+	struct wl_resource *resource;
+	const struct wl_message *message;
+	bool logging;
+	size_t i;
+	int n = 0, j;
+
+	if (client->error)
+		return;
+
+	logging = debug_server ||
+		  !wl_list_empty(&client->display->protocol_loggers);
+
+	for (i = 0; i < count && !client->error; i++) {
+		resource = events[i].resource;
+		message = &resource->object.interface->events[events[i].opcode];
+		if (resource->client != client) {
+			wl_log("compositor bug: The compositor tried to send "
+			       "a '%s.%s' event of another client's object.\n",
+			       resource->object.interface->name,
+			       message->name);
+			client->error = 1;
+			break;
+		}
+
+		if (!verify_objects(resource, events[i].opcode,
+				    events[i].args) ||
+		    wl_closure_marshal_in_place(&closures[n],
+						&resource->object,
+						events[i].opcode,
+						events[i].args, message) < 0) {
+			client->error = 1;
+			break;
+		}
+
+		if (logging)
+			log_closure(resource, &closures[n], true);
+
+		if (++n < WL_CLOSURE_BATCH_MAX && i + 1 < count)
+			continue;
+
+		if (wl_closure_send_array(closures, n, client->connection,
+					  flush) < 0)
+			client->error = 1;
+		for (j = 0; j < n; j++)
+			wl_closure_close_fds(&closures[j]);
+		n = 0;
+	}
+
+	/* Events marshalled before a failure are dropped */
+	for (j = 0; j < n; j++)
+		wl_closure_close_fds(&closures[j]);
+}
+
+/** Post a batch of events to a client
+ *
+ * \param client The client object
+ * \param events The events to post, in order
+ * \param count The number of events
+ *
+ * Does the same as calling wl_resource_post_event_array() for each
+ * event, but the events are serialized together, reserving space in the
+ * output buffer once for as many of them as fit. This is cheaper when
+ * many events go to the same client back to back, such as a full
+ * output description or frame callbacks for many surfaces.
+ *
+ * All resources must belong to \a client. If an event cannot be sent,
+ * the client is marked as failed, like with wl_resource_post_event(),
+ * and the rest of the batch is dropped.
+ *
+ * \sa wl_client_queue_events()
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT void
+wl_client_post_events(struct wl_client *client,
+		      const struct wl_resource_event *events, size_t count)
+{
+	handle_events(client, events, count, true);
+}
+
+/** Queue a batch of events to a client
+ *
+ * \param client The client object
+ * \param events The events to queue, in order
+ * \param count The number of events
+ *
+ * Like wl_client_post_events(), but for wl_resource_queue_event_array():
+ * the events do not cause the client to be flushed on their own.
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT void
+wl_client_queue_events(struct wl_client *client,
+		       const struct wl_resource_event *events, size_t count)
+{
+	handle_events(client, events, count, false);
+}
+
 WL_EXPORT void
 wl_resource_queue_event(struct wl_resource *resource, uint32_t opcode, ...)
 {
@@ -318,11 +477,301 @@ wl_resource_post_error(struct wl_resource *resource,
 	va_end(ap);
 }
 
+static void
+wl_client_disconnect(struct wl_client *client);
+
 static void
 destroy_client_with_error(struct wl_client *client, const char *reason)
 {
 	wl_log("%s (pid %u)\n", reason, client->pid);
-	wl_client_destroy(client);
+	wl_client_disconnect(client);
+}
+
+static const char *const quota_names[CLIENT_QUOTA_COUNT] = {
+	[WL_CLIENT_QUOTA_OBJECTS] = "object",
+	[WL_CLIENT_QUOTA_REQUEST_RATE] = "request rate",
+	[WL_CLIENT_QUOTA_FDS] = "fd",
+	[WL_CLIENT_QUOTA_SHM_BYTES] = "shm size",
+};
+
+/* What to wait for on the client socket */
+static uint32_t
+client_source_mask(struct wl_client *client)
+{
+	return (client->flush_pending ? WL_EVENT_WRITABLE : 0) |
+	       (client->throttled ? 0 : WL_EVENT_READABLE);
+}
+
+static int
+client_throttle_expired(void *data)
+{
+	struct wl_client *client = data;
+
+	client->throttled = false;
+	wl_event_source_fd_update(client->source, client_source_mask(client));
+	/* Requests already read from the socket would not wake us up */
+	wl_event_source_defer(client->source);
+
+	return 0;
+}
+
+/* Stop reading from the client until its request rate window ends */
+static bool
+client_throttle(struct wl_client *client)
+{
+	struct timespec now;
+	int64_t ms;
+
+	if (client->throttle_source == NULL) {
+		client->throttle_source =
+			wl_event_loop_add_timer(client->display->loop,
+						client_throttle_expired,
+						client);
+		if (client->throttle_source == NULL)
+			return false;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (client->rate_window_end.tv_sec - now.tv_sec) * 1000 +
+	     (client->rate_window_end.tv_nsec - now.tv_nsec + 999999) / 1000000;
+	if (ms < 1)
+		ms = 1;
+
+	if (wl_event_source_timer_update(client->throttle_source, ms) < 0)
+		return false;
+
+	client->throttled = true;
+	wl_event_source_fd_update(client->source, client_source_mask(client));
+
+	return true;
+}
+
+/* Called when the usage of a quota went over its limit. Returns false
+ * if what took it there must be refused. */
+static bool
+client_quota_exceeded(struct wl_client *client, enum wl_client_quota quota)
+{
+	struct wl_display *display = client->display;
+	struct client_quota *q = &client->quotas[quota];
+
+	if (!q->notified) {
+		q->notified = true;
+		if (display->quota_handler)
+			display->quota_handler(client, quota, q->usage,
+					       display->quota_handler_data);
+	}
+
+	switch (q->action) {
+	case WL_CLIENT_QUOTA_ACTION_THROTTLE:
+		if (quota == WL_CLIENT_QUOTA_REQUEST_RATE)
+			return !client_throttle(client);
+		return true;
+	case WL_CLIENT_QUOTA_ACTION_DISCONNECT:
+		wl_client_post_implementation_error(client,
+						    "%s quota exceeded",
+						    quota_names[quota]);
+		return false;
+	case WL_CLIENT_QUOTA_ACTION_NOTIFY:
+	default:
+		return true;
+	}
+}
+
+static int
+client_quota_charge(struct wl_client *client, enum wl_client_quota quota,
+		    int64_t delta)
+{
+	struct client_quota *q = &client->quotas[quota];
+
+	if (delta < 0) {
+		if (q->usage < (uint64_t) -delta)
+			q->usage = 0;
+		else
+			q->usage -= (uint64_t) -delta;
+		if (q->usage <= q->limit)
+			q->notified = false;
+		return 0;
+	}
+
+	q->usage += delta;
+	if (q->limit == 0 || q->usage <= q->limit ||
+	    client_quota_exceeded(client, quota))
+		return 0;
+
+	q->usage -= delta;
+	errno = EDQUOT;
+
+	return -1;
+}
+
+/* Counts one more request against the request rate quota. Returns false
+ * if it must not be dispatched now. */
+static bool
+client_rate_charge(struct wl_client *client)
+{
+	struct client_quota *rate =
+		&client->quotas[WL_CLIENT_QUOTA_REQUEST_RATE];
+
+	return rate->limit == 0 || ++rate->usage <= rate->limit ||
+	       client_quota_exceeded(client, WL_CLIENT_QUOTA_REQUEST_RATE);
+}
+
+/* Start a new request rate window if the current one is over */
+static void
+client_rate_window_update(struct wl_client *client)
+{
+	struct client_quota *rate =
+		&client->quotas[WL_CLIENT_QUOTA_REQUEST_RATE];
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec < client->rate_window_end.tv_sec ||
+	    (now.tv_sec == client->rate_window_end.tv_sec &&
+	     now.tv_nsec < client->rate_window_end.tv_nsec))
+		return;
+
+	rate->usage = 0;
+	rate->notified = false;
+	client->rate_window_end = now;
+	client->rate_window_end.tv_sec++;
+}
+
+static void
+post_invalid_arguments(struct wl_resource *resource,
+		       const struct wl_message *message)
+{
+	wl_resource_post_error(resource->client->display_resource,
+			       WL_DISPLAY_ERROR_INVALID_METHOD,
+			       "invalid arguments for %s@%u.%s",
+			       resource->object.interface->name,
+			       resource->object.id,
+			       message->name);
+}
+
+/* Handles a request of the given size to a resource with a view
+ * implementation. The request is read in place unless it has to be
+ * logged, which needs a demarshalled closure. */
+static int
+dispatch_view(struct wl_client *client, struct wl_resource *resource,
+	      const struct wl_message *message, int opcode, int size)
+{
+	const wl_resource_view_func_t *implementation =
+		resource->object.implementation;
+	struct wl_connection *connection = client->connection;
+	struct wl_closure *closure;
+	struct wl_message_view view;
+
+	if (!debug_server &&
+	    wl_list_empty(&client->display->protocol_loggers)) {
+		if (wl_connection_view(connection, size, &client->objects,
+				       message, &view) < 0) {
+			if (errno == ENOMEM)
+				wl_resource_post_no_memory(resource);
+			else
+				post_invalid_arguments(resource, message);
+			return -1;
+		}
+
+		implementation[opcode](client, resource, &view);
+		wl_connection_consume(connection, size);
+
+		return 0;
+	}
+
+	closure = wl_connection_demarshal(connection, size,
+					  &client->objects, message);
+	if (closure == NULL && errno == ENOMEM) {
+		wl_resource_post_no_memory(resource);
+		return -1;
+	} else if (closure == NULL ||
+		   wl_closure_lookup_objects(closure, &client->objects) < 0) {
+		post_invalid_arguments(resource, message);
+		wl_closure_destroy(closure);
+		return -1;
+	}
+
+	log_closure(resource, closure, false);
+
+	wl_closure_view(closure, &view);
+	implementation[opcode](client, resource, &view);
+	wl_closure_destroy(closure);
+
+	return 0;
+}
+
+#define MAX_BATCH_REQUESTS 64
+
+/* Demarshals the run of consecutive requests with the same opcode to
+ * the same resource starting at the head of the connection, up to
+ * MAX_BATCH_REQUESTS of them, and passes them to the batch handler in
+ * one call. Requests demarshalled before an invalid one are dispatched
+ * before the error is posted for it. The first request is already
+ * charged to the request rate quota, the run ends before one that the
+ * quota refuses. */
+static int
+dispatch_batch(struct wl_client *client, struct wl_resource *resource,
+	       const struct wl_message *message, int opcode, int size)
+{
+	struct wl_connection *connection = client->connection;
+	struct wl_closure *closures[MAX_BATCH_REQUESTS];
+	union wl_argument *args[MAX_BATCH_REQUESTS];
+	const struct wl_interface *interface = resource->object.interface;
+	uint32_t id = resource->object.id;
+	uint32_t count = 0, i;
+	uint32_t p[2];
+	int len, error = 0;
+
+	while (true) {
+		closures[count] = wl_connection_demarshal(connection, size,
+							  &client->objects,
+							  message);
+		if (closures[count] == NULL && errno == ENOMEM) {
+			error = ENOMEM;
+			break;
+		} else if (closures[count] == NULL ||
+			   wl_closure_lookup_objects(closures[count],
+						     &client->objects) < 0) {
+			wl_closure_destroy(closures[count]);
+			error = EINVAL;
+			break;
+		}
+
+		log_closure(resource, closures[count], false);
+		args[count] = closures[count]->args;
+		count++;
+
+		len = wl_connection_pending_input(connection);
+		if (count == MAX_BATCH_REQUESTS || (size_t) len < sizeof p)
+			break;
+
+		wl_connection_copy(connection, p, sizeof p);
+		size = p[1] >> 16;
+		if (p[0] != id || (int) (p[1] & 0xffff) != opcode || len < size)
+			break;
+
+		if (!client_rate_charge(client))
+			break;
+	}
+
+	if (count > 0)
+		resource->batch(client, resource, opcode, args, count);
+
+	/* The handler owns the fds, as with wl_closure_invoke() */
+	for (i = 0; i < count; i++) {
+		wl_closure_clear_fds(closures[i]);
+		wl_closure_destroy(closures[i]);
+	}
+
+	/* The handler may have destroyed the resource */
+	if (error == ENOMEM)
+		wl_client_post_no_memory(client);
+	else if (error)
+		wl_resource_post_error(client->display_resource,
+				       WL_DISPLAY_ERROR_INVALID_METHOD,
+				       "invalid arguments for %s@%u.%s",
+				       interface->name, id, message->name);
+
+	return error ? -1 : 0;
 }
 
 static int
@@ -337,10 +786,11 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 	uint32_t p[2];
 	uint32_t resource_flags;
 	int opcode, size, since;
+	bool dispatched = false;
 	int len;
 
 	if (mask & WL_EVENT_HANGUP) {
-		wl_client_destroy(client);
+		wl_client_disconnect(client);
 		return 1;
 	}
 
@@ -356,26 +806,60 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 			    client, "failed to flush client connection");
 			return 1;
 		} else if (len >= 0) {
+			client->flush_pending = false;
 			wl_event_source_fd_update(client->source,
-						  WL_EVENT_READABLE);
+						  client_source_mask(client));
 		}
 	}
 
-	len = 0;
+	/* Over its request rate, wait for the throttle timer */
+	if (client->throttled)
+		return 1;
+
 	if (mask & WL_EVENT_READABLE) {
 		len = wl_connection_read(connection);
-		if (len == 0 || (len < 0 && errno != EAGAIN)) {
+		/* A full buffer only happens with requests left over from
+		 * a dispatch that ran out of time, handle those first. The
+		 * loop below disconnects clients whose next message does not
+		 * fit in the buffer. */
+		if (len == 0 ||
+		    (len < 0 && errno != EAGAIN && errno != EOVERFLOW)) {
 			destroy_client_with_error(
 			    client, "failed to read client connection");
 			return 1;
 		}
 	}
 
-	while (len >= 0 && (size_t) len >= sizeof p) {
+	if (client->quotas[WL_CLIENT_QUOTA_REQUEST_RATE].limit > 0)
+		client_rate_window_update(client);
+
+	len = wl_connection_pending_input(connection);
+	while ((size_t) len >= sizeof p) {
 		wl_connection_copy(connection, p, sizeof p);
 		opcode = p[1] & 0xffff;
 		size = p[1] >> 16;
-		if (len < size)
+		if (len < size) {
+			/* Reads are not fatal while the buffer is full, so
+			 * a message that can never fit must be. */
+			if (size > WL_CONNECTION_BUFFER_SIZE ||
+			    len == WL_CONNECTION_BUFFER_SIZE) {
+				destroy_client_with_error(
+				    client, "message too big for the buffer");
+				return 1;
+			}
+			break;
+		}
+
+		/* The input is already read, so make sure to come back
+		 * for the rest if out of time. */
+		if (dispatched &&
+		    wl_event_loop_out_of_time(client->display->loop)) {
+			wl_event_source_defer(client->source);
+			break;
+		}
+		dispatched = true;
+
+		if (!client_rate_charge(client))
 			break;
 
 		resource = wl_map_lookup(&client->objects, p[0]);
@@ -413,6 +897,33 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 		}
 
 
+		if (resource->views &&
+		    !(resource_flags & WL_MAP_ENTRY_LEGACY)) {
+			if (dispatch_view(client, resource, message,
+					  opcode, size) < 0)
+				break;
+
+			if (client->error)
+				break;
+
+			len = wl_connection_pending_input(connection);
+			continue;
+		}
+
+		if (resource->batch && opcode < 64 &&
+		    (resource->batch_opcodes & ((uint64_t) 1 << opcode)) &&
+		    !(resource_flags & WL_MAP_ENTRY_LEGACY)) {
+			if (dispatch_batch(client, resource, message,
+					   opcode, size) < 0)
+				break;
+
+			if (client->error || client->throttled)
+				break;
+
+			len = wl_connection_pending_input(connection);
+			continue;
+		}
+
 		closure = wl_connection_demarshal(client->connection, size,
 						  &client->objects, message);
 
@@ -472,7 +983,8 @@ wl_client_connection_data(int fd, uint32_t mask, void *data)
 WL_EXPORT void
 wl_client_flush(struct wl_client *client)
 {
-	wl_connection_flush(client->connection);
+	if (client->connection)
+		wl_connection_flush(client->connection);
 }
 
 /** Get the display object for the given client
@@ -542,7 +1054,14 @@ wl_client_create(struct wl_display *display, int fd)
 	if (client->connection == NULL)
 		goto err_source;
 
+	/* Best effort, the client works the same with a fixed buffer */
+	if (display->client_sndbuf_max > 0)
+		wl_connection_set_sndbuf_range(client->connection,
+					       display->client_sndbuf_min,
+					       display->client_sndbuf_max);
+
 	wl_map_init(&client->objects, WL_MAP_SERVER_SIDE);
+	memcpy(client->quotas, display->client_quotas, sizeof client->quotas);
 
 	if (wl_map_insert_at(&client->objects, 0, 0, NULL) < 0)
 		goto err_map;
@@ -564,7 +1083,7 @@ err_map:
 err_source:
 	wl_event_source_remove(client->source);
 err_client:
-	free(client);
+	wl_free(client);
 	return NULL;
 }
 
@@ -629,14 +1148,136 @@ wl_client_get_credentials(struct wl_client *client,
  * from the client's file descriptor. The compositor can validate the client's
  * request with the contexts and make a decision whether it permits or deny it.
  *
+ * Returns -1 once the connection of a client being torn down
+ * incrementally has been closed, see
+ * wl_display_set_client_teardown_budget().
+ *
  * \memberof wl_client
  */
 WL_EXPORT int
 wl_client_get_fd(struct wl_client *client)
 {
+	if (client->connection == NULL)
+		return -1;
+
 	return wl_connection_get_fd(client->connection);
 }
 
+/** Get the counters of the adaptive socket send buffer of the client
+ *
+ * \param client The client object
+ * \param stats Where to store the counters
+ * \return 0 on success, -1 with errno set to ENOTSUP if adaptive sizing
+ * is not enabled for the client
+ *
+ * \sa wl_display_set_client_socket_buffer_range()
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT int
+wl_client_get_socket_buffer_stats(struct wl_client *client,
+				  struct wl_socket_buffer_stats *stats)
+{
+	if (client->connection == NULL) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	return wl_connection_get_sndbuf_stats(client->connection, stats);
+}
+
+/** Set a quota of the client
+ *
+ * \param client The client object
+ * \param quota The quota to set
+ * \param limit The highest allowed usage, or 0 for no limit
+ * \param action What to do when the usage goes over \a limit
+ * \return 0 on success, -1 with errno set to EINVAL for an unknown
+ * quota or action
+ *
+ * Overrides the quota the client got from wl_display_set_client_quota()
+ * when it was created. Usage is counted even without a limit, see
+ * wl_client_get_quota_usage().
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT int
+wl_client_set_quota(struct wl_client *client, enum wl_client_quota quota,
+		    uint64_t limit, enum wl_client_quota_action action)
+{
+	struct client_quota *q;
+
+	if ((unsigned int) quota >= CLIENT_QUOTA_COUNT ||
+	    (unsigned int) action > WL_CLIENT_QUOTA_ACTION_DISCONNECT) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	q = &client->quotas[quota];
+	q->limit = limit;
+	q->action = action;
+	q->notified = false;
+
+	return 0;
+}
+
+/** Get the current usage of a quota of the client
+ *
+ * \param client The client object
+ * \param quota The quota to query
+ * \return The usage, or 0 for an unknown quota
+ *
+ * For WL_CLIENT_QUOTA_REQUEST_RATE, this is the number of requests
+ * received in the current or last one second window, which is only
+ * counted while the quota has a limit.
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT uint64_t
+wl_client_get_quota_usage(struct wl_client *client,
+			  enum wl_client_quota quota)
+{
+	if ((unsigned int) quota >= CLIENT_QUOTA_COUNT)
+		return 0;
+
+	return client->quotas[quota].usage;
+}
+
+/** Account resources held on behalf of the client
+ *
+ * \param client The client object
+ * \param quota The quota to charge
+ * \param delta The amount to add to the usage, negative to release
+ * \return 0 on success, -1 if the charge was refused
+ *
+ * libwayland-server charges the objects the client creates, as well as
+ * the memory and file descriptors of its wl_shm pools. This lets the
+ * compositor charge what it holds itself for the client, such as the
+ * file descriptors of dmabuf planes or sync objects, and release it
+ * again later.
+ *
+ * If the charge takes the usage over the limit, the quota handler is
+ * called. With WL_CLIENT_QUOTA_ACTION_DISCONNECT, the charge is then
+ * refused: -1 is returned with errno set to EDQUOT and the client is
+ * sent an implementation error. Releasing never fails.
+ *
+ * WL_CLIENT_QUOTA_REQUEST_RATE cannot be charged, and fails with EINVAL.
+ *
+ * \memberof wl_client
+ */
+WL_EXPORT int
+wl_client_quota_charge(struct wl_client *client, enum wl_client_quota quota,
+		       int64_t delta)
+{
+	if ((unsigned int) quota >= CLIENT_QUOTA_COUNT ||
+	    quota == WL_CLIENT_QUOTA_REQUEST_RATE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return client_quota_charge(client, quota, delta);
+}
+
 /** Look up an object in the client name space
  *
  * \param client The client object
@@ -717,22 +1358,47 @@ resource_is_deprecated(struct wl_resource *resource)
 	return false;
 }
 
+static void
+release_attachments(struct wl_resource *resource)
+{
+	struct wl_array *funcs =
+		&resource->client->display->resource_attachments;
+	wl_resource_attachment_destroy_func_t *destroy = funcs->data;
+	void **slots = resource->attachments.data;
+	size_t i, count;
+
+	count = resource->attachments.size / sizeof *slots;
+	for (i = 0; i < count; i++) {
+		if (slots[i] && destroy[i])
+			destroy[i](resource, slots[i]);
+	}
+
+	wl_priv_array_release(&resource->attachments);
+}
+
 static enum wl_iterator_result
 destroy_resource(void *element, void *data, uint32_t flags)
 {
 	struct wl_resource *resource = element;
+	bool deprecated = resource_is_deprecated(resource);
 
 	wl_signal_emit(&resource->deprecated_destroy_signal, resource);
 	/* Don't emit the new signal for deprecated resources, as that would
 	 * access memory outside the bounds of the deprecated struct */
-	if (!resource_is_deprecated(resource))
+	if (!deprecated)
 		wl_priv_signal_final_emit(&resource->destroy_signal, resource);
 
 	if (resource->destroy)
 		resource->destroy(resource);
 
-	if (!(flags & WL_MAP_ENTRY_LEGACY))
-		free(resource);
+	if (!deprecated)
+		release_attachments(resource);
+
+	if (!(flags & WL_MAP_ENTRY_LEGACY)) {
+		client_quota_charge(resource->client,
+				    WL_CLIENT_QUOTA_OBJECTS, -1);
+		wl_free(resource);
+	}
 
 	return WL_ITERATOR_CONTINUE;
 }
@@ -854,6 +1520,90 @@ wl_resource_get_destroy_listener(struct wl_resource *resource,
 	return wl_priv_signal_get(&resource->destroy_signal, notify);
 }
 
+/** Attach data to a resource under a registered key
+ *
+ * \param resource The resource object
+ * \param key A key returned by wl_display_register_resource_attachment()
+ * \param data The data to attach, or NULL to clear the slot
+ * \return 0 on success, -1 on failure
+ *
+ * Stores \a data in the slot of \a resource identified by \a key,
+ * replacing any previous value without calling the key's destroy
+ * function for it. When the resource is destroyed, after its destroy
+ * listeners and destructor have run, the destroy function of every key
+ * with a non-NULL slot is called.
+ *
+ * This fails with errno set to EINVAL if the key was not registered on
+ * the resource's display or if the resource was created with the
+ * deprecated wl_client_add_resource(), and with ENOMEM if the slot
+ * storage could not be grown.
+ *
+ * \sa wl_resource_get_attachment
+ *
+ * \memberof wl_resource
+ */
+WL_EXPORT int
+wl_resource_set_attachment(struct wl_resource *resource, int key, void *data)
+{
+	struct wl_array *funcs =
+		&resource->client->display->resource_attachments;
+	size_t old_size, size;
+	void **slots;
+
+	if (key < 0 ||
+	    (size_t) key >= funcs->size / sizeof(wl_resource_attachment_destroy_func_t) ||
+	    resource_is_deprecated(resource)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	old_size = resource->attachments.size;
+	size = ((size_t) key + 1) * sizeof *slots;
+	if (old_size < size) {
+		if (!wl_priv_array_add(&resource->attachments,
+				       size - old_size)) {
+			errno = ENOMEM;
+			return -1;
+		}
+		memset((char *) resource->attachments.data + old_size, 0,
+		       size - old_size);
+	}
+
+	slots = resource->attachments.data;
+	slots[key] = data;
+
+	return 0;
+}
+
+/** Get the data attached to a resource under a registered key
+ *
+ * \param resource The resource object
+ * \param key A key returned by wl_display_register_resource_attachment()
+ * \return The attached data, or NULL if none was set
+ *
+ * Unlike looking up per-resource state with
+ * wl_resource_get_destroy_listener(), which walks the listener list of
+ * the destroy signal, this is a constant time lookup.
+ *
+ * \sa wl_resource_set_attachment
+ *
+ * \memberof wl_resource
+ */
+WL_EXPORT void *
+wl_resource_get_attachment(struct wl_resource *resource, int key)
+{
+	void **slots;
+
+	if (key < 0 || resource_is_deprecated(resource))
+		return NULL;
+
+	if ((size_t) key >= resource->attachments.size / sizeof *slots)
+		return NULL;
+
+	slots = resource->attachments.data;
+	return slots[key];
+}
+
 /** Retrieve the interface name (class) of a resource object.
  *
  * \param resource The resource object
@@ -917,10 +1667,63 @@ wl_client_get_destroy_late_listener(struct wl_client *client,
 	return wl_priv_signal_get(&client->destroy_late_signal, notify);
 }
 
+static void
+client_free(struct wl_client *client)
+{
+	wl_priv_signal_final_emit(&client->destroy_late_signal, client);
+
+	wl_list_remove(&client->link);
+	wl_list_remove(&client->resource_created_signal.listener_list);
+	wl_free(client);
+}
+
+static enum wl_iterator_result
+destroy_resource_budgeted(void *element, void *data, uint32_t flags)
+{
+	struct wl_resource *resource = element;
+	struct wl_client *client = resource->client;
+	uint32_t id = resource->object.id;
+	uint32_t *budget = data;
+
+	if (*budget == 0)
+		return WL_ITERATOR_STOP;
+
+	destroy_resource(resource, NULL, flags);
+	/* Clear the slot so destructors of later resources do not find it */
+	wl_map_insert_at(&client->objects, 0, id, NULL);
+	(*budget)--;
+
+	return WL_ITERATOR_CONTINUE;
+}
+
+/* Destroy up to *budget resources of a detached client, continuing
+ * where the previous slice stopped, and free the client once it has
+ * none left. Returns true if the client was freed. */
+static bool
+client_teardown_slice(struct wl_client *client, uint32_t *budget)
+{
+	wl_map_for_each_from(&client->objects, &client->teardown_next,
+			     destroy_resource_budgeted, budget);
+	if (*budget == 0)
+		return false;
+
+	wl_map_release(&client->objects);
+	client_free(client);
+
+	return true;
+}
+
 WL_EXPORT void
 wl_client_destroy(struct wl_client *client)
 {
 	uint32_t serial = 0;
+	uint32_t budget = UINT32_MAX;
+
+	if (client->connection == NULL) {
+		/* Already detached by an incremental teardown, finish it */
+		client_teardown_slice(client, &budget);
+		return;
+	}
 
 	wl_priv_signal_final_emit(&client->destroy_signal, client);
 
@@ -928,13 +1731,90 @@ wl_client_destroy(struct wl_client *client)
 	wl_map_for_each(&client->objects, destroy_resource, &serial);
 	wl_map_release(&client->objects);
 	wl_event_source_remove(client->source);
+	if (client->throttle_source)
+		wl_event_source_remove(client->throttle_source);
 	close(wl_connection_destroy(client->connection));
 
-	wl_priv_signal_final_emit(&client->destroy_late_signal, client);
+	client_free(client);
+}
+
+/* Destroy a client whose connection broke or hung up. With a teardown
+ * budget set, only the connection is closed here and the resources are
+ * destroyed in slices from the event loop. */
+static void
+wl_client_disconnect(struct wl_client *client)
+{
+	struct wl_display *display = client->display;
+	uint64_t slice = 1;
+	int ret;
+
+	if (display->teardown_budget == 0) {
+		wl_client_destroy(client);
+		return;
+	}
+
+	wl_priv_signal_final_emit(&client->destroy_signal, client);
+
+	/* Nothing can be sent to the client from now on */
+	client->error = 1;
+
+	wl_client_flush(client);
+	wl_event_source_remove(client->source);
+	if (client->throttle_source) {
+		wl_event_source_remove(client->throttle_source);
+		client->throttle_source = NULL;
+	}
+	close(wl_connection_destroy(client->connection));
+	client->connection = NULL;
+
+	wl_list_remove(&client->link);
+	wl_list_insert(display->teardown_list.prev, &client->link);
+
+	ret = write(display->teardown_efd, &slice, sizeof slice);
+	assert(ret >= 0 || errno == EAGAIN);
+}
+
+static int
+handle_client_teardown(int fd, uint32_t mask, void *data)
+{
+	struct wl_display *display = data;
+	struct wl_client *client;
+	uint32_t budget = display->teardown_budget;
+	uint64_t slice = 1;
+
+	if (read(fd, &slice, sizeof slice) < 0 && errno != EAGAIN)
+		return 0;
+
+	if (budget == 0)
+		budget = UINT32_MAX;
+
+	while (budget > 0 && !wl_list_empty(&display->teardown_list)) {
+		client = wl_container_of(display->teardown_list.next,
+					 client, link);
+		client_teardown_slice(client, &budget);
+	}
+
+	/* Come back on the next event loop iteration for the rest */
+	if (!wl_list_empty(&display->teardown_list)) {
+		slice = 1;
+		if (write(fd, &slice, sizeof slice) < 0 && errno != EAGAIN)
+			wl_log("failed to schedule client teardown: %s\n",
+			       strerror(errno));
+	}
 
-	wl_list_remove(&client->link);
-	wl_list_remove(&client->resource_created_signal.listener_list);
-	free(client);
+	return 0;
+}
+
+static void
+finish_client_teardowns(struct wl_display *display)
+{
+	struct wl_client *client;
+
+	while (!wl_list_empty(&display->teardown_list)) {
+		client = wl_container_of(display->teardown_list.next,
+					 client, link);
+		wl_client_destroy(client);
+	}
 }
 
 /* Check if a global filter is registered and use it if any.
@@ -1113,7 +1993,7 @@ wl_display_create(void)
 
 	display->loop = wl_event_loop_create();
 	if (display->loop == NULL) {
-		free(display);
+		wl_free(display);
 		return NULL;
 	}
 
@@ -1135,6 +2015,9 @@ wl_display_create(void)
 	wl_list_init(&display->client_list);
 	wl_list_init(&display->registry_resource_list);
 	wl_list_init(&display->protocol_loggers);
+	wl_list_init(&display->teardown_list);
+
+	display->teardown_efd = -1;
 
 	wl_priv_signal_init(&display->destroy_signal);
 	wl_priv_signal_init(&display->create_client_signal);
@@ -1146,6 +2029,9 @@ wl_display_create(void)
 	display->global_filter_data = NULL;
 
 	wl_array_init(&display->additional_shm_formats);
+	wl_array_init(&display->shm_format_table);
+	wl_array_init(&display->shm_format_events);
+	wl_array_init(&display->resource_attachments);
 
 	return display;
 
@@ -1153,7 +2039,7 @@ err_term_source:
 	close(display->terminate_efd);
 err_eventfd:
 	wl_event_loop_destroy(display->loop);
-	free(display);
+	wl_free(display);
 	return NULL;
 }
 
@@ -1171,7 +2057,7 @@ wl_socket_destroy(struct wl_socket *s)
 	if (s->fd_lock >= 0)
 		close(s->fd_lock);
 
-	free(s);
+	wl_free(s);
 }
 
 static struct wl_socket *
@@ -1208,6 +2094,8 @@ wl_display_destroy(struct wl_display *display)
 	struct wl_socket *s, *next;
 	struct wl_global *global, *gnext;
 
+	finish_client_teardowns(display);
+
 	wl_priv_signal_final_emit(&display->destroy_signal, display);
 
 	wl_list_for_each_safe(s, next, &display->socket_list, link) {
@@ -1217,16 +2105,27 @@ wl_display_destroy(struct wl_display *display)
 	close(display->terminate_efd);
 	wl_event_source_remove(display->term_source);
 
+	if (display->sndbuf_timer)
+		wl_event_source_remove(display->sndbuf_timer);
+
+	if (display->teardown_source) {
+		close(display->teardown_efd);
+		wl_event_source_remove(display->teardown_source);
+	}
+
 	wl_event_loop_destroy(display->loop);
 
 	wl_list_for_each_safe(global, gnext, &display->global_list, link)
-		free(global);
+		wl_free(global);
 
-	wl_array_release(&display->additional_shm_formats);
+	wl_priv_array_release(&display->additional_shm_formats);
+	wl_priv_array_release(&display->shm_format_table);
+	wl_priv_array_release(&display->shm_format_events);
+	wl_priv_array_release(&display->resource_attachments);
 
 	wl_list_remove(&display->protocol_loggers);
 
-	free(display);
+	wl_free(display);
 }
 
 /** Set a filter function for global objects
@@ -1360,7 +2259,7 @@ wl_global_destroy(struct wl_global *global)
 	if (!global->removed)
 		wl_global_remove(global);
 	wl_list_remove(&global->link);
-	free(global);
+	wl_free(global);
 }
 
 WL_EXPORT const struct wl_interface *
@@ -1494,6 +2393,38 @@ wl_display_run(struct wl_display *display)
 	}
 }
 
+static void
+sndbuf_timer_arm(struct wl_display *display, int ms)
+{
+	if (ms < 0)
+		return;
+
+	/* 0 would disarm the timer */
+	if (wl_event_source_timer_update(display->sndbuf_timer,
+					 ms > 0 ? ms : 1) == 0)
+		display->sndbuf_timer_armed = true;
+}
+
+/* Give the send buffers of all clients a chance to shrink, and come
+ * back as long as one of them still can. */
+static int
+handle_sndbuf_timer(void *data)
+{
+	struct wl_display *display = data;
+	struct wl_client *client;
+	int ms, next = -1;
+
+	display->sndbuf_timer_armed = false;
+	wl_list_for_each(client, &display->client_list, link) {
+		ms = wl_connection_sndbuf_idle(client->connection);
+		if (ms >= 0 && (next < 0 || ms < next))
+			next = ms;
+	}
+	sndbuf_timer_arm(display, next);
+
+	return 0;
+}
+
 WL_EXPORT void
 wl_display_flush_clients(struct wl_display *display)
 {
@@ -1503,12 +2434,20 @@ wl_display_flush_clients(struct wl_display *display)
 	wl_list_for_each_safe(client, next, &display->client_list, link) {
 		ret = wl_connection_flush(client->connection);
 		if (ret < 0 && errno == EAGAIN) {
+			client->flush_pending = true;
 			wl_event_source_fd_update(client->source,
-						  WL_EVENT_WRITABLE |
-						  WL_EVENT_READABLE);
+						  client_source_mask(client));
 		} else if (ret < 0) {
-			wl_client_destroy(client);
+			wl_client_disconnect(client);
+			continue;
 		}
+
+		/* A buffer grown by this flush shrinks from the timer if
+		 * the client goes quiet */
+		if (display->sndbuf_timer && !display->sndbuf_timer_armed)
+			sndbuf_timer_arm(display,
+					 wl_connection_sndbuf_idle(
+						 client->connection));
 	}
 }
 
@@ -1548,6 +2487,175 @@ wl_display_destroy_clients(struct wl_display *display)
 		wl_log("wl_display_destroy_clients: cannot destroy all clients because "
 			   "new ones were created by destroy callbacks\n");
 	}
+
+	finish_client_teardowns(display);
+}
+
+/** Tear down disconnected clients incrementally
+ *
+ * \param display The display object
+ * \param budget The maximum number of resources destroyed per event loop
+ * iteration, or 0 to tear down disconnected clients synchronously
+ * \return 0 on success, -1 on failure
+ *
+ * By default, when a client hangs up or its connection fails, all of its
+ * resources are destroyed at once, which can stall the compositor for a
+ * long time when the client owns many objects.
+ *
+ * With a non-zero budget, the socket of such a client is closed right
+ * away and the client is removed from the client list, but its resources
+ * are destroyed from the event loop, at most \a budget of them per
+ * wl_event_loop_dispatch() call. The client destroy signal is still
+ * emitted before any resource is destroyed, and the late destroy signal
+ * after all of them have been, at which point the client is freed.
+ *
+ * Calling wl_client_destroy() on such a client, as well as
+ * wl_display_destroy_clients() and wl_display_destroy(), finish its
+ * teardown synchronously. Clients destroyed with wl_client_destroy() by
+ * the compositor are always destroyed synchronously.
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_set_client_teardown_budget(struct wl_display *display,
+				      uint32_t budget)
+{
+	if (budget > 0 && display->teardown_source == NULL) {
+		display->teardown_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (display->teardown_efd < 0)
+			return -1;
+
+		display->teardown_source =
+			wl_event_loop_add_fd(display->loop,
+					     display->teardown_efd,
+					     WL_EVENT_READABLE,
+					     handle_client_teardown, display);
+		if (display->teardown_source == NULL) {
+			close(display->teardown_efd);
+			display->teardown_efd = -1;
+			return -1;
+		}
+	}
+
+	display->teardown_budget = budget;
+
+	return 0;
+}
+
+/** Adapt the socket send buffers of new clients to their bursts
+ *
+ * \param display The display object
+ * \param min_size The smallest send buffer to use
+ * \param max_size The largest send buffer to use, or 0 to keep the
+ * kernel's default
+ * \return 0 on success, -1 on failure with errno set, to EINVAL if
+ * \a min_size is 0 or larger than \a max_size
+ *
+ * By default, every client socket keeps the send buffer size the kernel
+ * gave it, so a burst of events larger than that, such as the initial
+ * globals or a configure storm, fails to flush with EAGAIN, while idle
+ * clients hold kernel memory they never use.
+ *
+ * With a range set, the send buffer of each new client is doubled, up
+ * to \a max_size, whenever a flush would fail with EAGAIN. About once a
+ * second it is shrunk back towards twice the most data seen queued in
+ * the socket since, down to \a min_size, from a timer of the display's
+ * event loop so that clients that went quiet shrink too. The timer is
+ * started by wl_display_flush_clients() and only runs while a buffer
+ * can still shrink. Sizes are as reported by getsockopt() for
+ * SO_SNDBUF.
+ *
+ * \sa wl_client_get_socket_buffer_stats()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_set_client_socket_buffer_range(struct wl_display *display,
+					  size_t min_size, size_t max_size)
+{
+	if (max_size > 0 && (min_size == 0 || min_size > max_size)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (max_size > 0 && display->sndbuf_timer == NULL) {
+		display->sndbuf_timer =
+			wl_event_loop_add_timer(display->loop,
+						handle_sndbuf_timer, display);
+		if (display->sndbuf_timer == NULL)
+			return -1;
+	}
+
+	display->client_sndbuf_min = min_size;
+	display->client_sndbuf_max = max_size;
+
+	return 0;
+}
+
+/** Set a quota for new clients
+ *
+ * \param display The display object
+ * \param quota The quota to set
+ * \param limit The highest allowed usage, or 0 for no limit
+ * \param action What to do when the usage goes over \a limit
+ * \return 0 on success, -1 with errno set to EINVAL for an unknown
+ * quota or action
+ *
+ * Quotas stop a single client from using up the objects, file
+ * descriptors, memory or dispatch time of the compositor. They are
+ * checked with a counter each time a client creates an object, sends a
+ * request or is charged resources, see wl_client_quota_charge().
+ *
+ * The request rate is counted in windows of one second. A client
+ * throttled for going over it has no more requests dispatched until the
+ * window ends, and WL_CLIENT_QUOTA_ACTION_THROTTLE acts like
+ * WL_CLIENT_QUOTA_ACTION_NOTIFY for the other quotas.
+ *
+ * The quota applies to clients created after this call. Use
+ * wl_client_set_quota() to change it for an existing client.
+ *
+ * \sa wl_display_set_client_quota_handler()
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_set_client_quota(struct wl_display *display,
+			    enum wl_client_quota quota, uint64_t limit,
+			    enum wl_client_quota_action action)
+{
+	if ((unsigned int) quota >= CLIENT_QUOTA_COUNT ||
+	    (unsigned int) action > WL_CLIENT_QUOTA_ACTION_DISCONNECT) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	display->client_quotas[quota].limit = limit;
+	display->client_quotas[quota].action = action;
+
+	return 0;
+}
+
+/** Set the function called when a client goes over a quota
+ *
+ * \param display The display object
+ * \param handler The function to call, or NULL
+ * \param data User data passed to \a handler
+ *
+ * The handler is called with the usage that went over the limit, before
+ * the action of the quota is taken. It is not called again until the
+ * usage has gone back down to the limit, or for
+ * WL_CLIENT_QUOTA_REQUEST_RATE, until a later one second window. It must
+ * not destroy the client.
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_set_client_quota_handler(struct wl_display *display,
+				    wl_client_quota_func_t handler,
+				    void *data)
+{
+	display->quota_handler = handler;
+	display->quota_handler_data = data;
 }
 
 static int
@@ -1875,6 +2983,7 @@ wl_resource_set_implementation(struct wl_resource *resource,
 	resource->data = data;
 	resource->destroy = destroy;
 	resource->dispatcher = NULL;
+	resource->views = false;
 }
 
 WL_EXPORT void
@@ -1887,6 +2996,94 @@ wl_resource_set_dispatcher(struct wl_resource *resource,
 	resource->object.implementation = implementation;
 	resource->data = data;
 	resource->destroy = destroy;
+	resource->views = false;
+}
+
+/** Set a resource's implementation to request handlers taking views
+ *
+ * \param resource The resource object
+ * \param implementation A vector of wl_resource_view_func_t, one per
+ * request, such as a scanner-generated struct foo_view_interface
+ * \param data User data to be associated with the resource
+ * \param destroy The destroy function of the resource
+ *
+ * Requests to \c resource are validated but not unpacked. Each handler is
+ * passed a wl_message_view reading the arguments in place from the
+ * connection buffer, so handlers only decode the arguments they use.
+ *
+ * \memberof wl_resource
+ */
+WL_EXPORT void
+wl_resource_set_view_implementation(struct wl_resource *resource,
+				    const void *implementation,
+				    void *data,
+				    wl_resource_destroy_func_t destroy)
+{
+	resource->object.implementation = implementation;
+	resource->data = data;
+	resource->destroy = destroy;
+	resource->dispatcher = NULL;
+	resource->views = true;
+}
+
+/** Receive runs of identical requests to a resource in one call
+ *
+ * \param resource The resource object
+ * \param opcodes Bitmask of the request opcodes to batch, bit n standing
+ * for opcode n
+ * \param batch The handler for batched requests, or NULL to stop batching
+ * \return 0 on success, -1 with errno set to EINVAL if an opcode in
+ * \a opcodes does not exist or creates a new object
+ *
+ * When the client sends several consecutive requests with one of the
+ * given opcodes to \c resource, they are demarshalled together and
+ * passed to \a batch in a single call instead of calling the
+ * implementation once per request. A run may consist of a single
+ * request. Requests with other opcodes still go through the resource's
+ * implementation.
+ *
+ * This lets compositors accumulate e.g. wl_surface.damage_buffer or
+ * wl_region.add rectangles in one pass. The arguments passed to the
+ * handler are only valid during the call, and file descriptors in them
+ * are owned by the handler, as with regular requests. Object arguments
+ * are looked up before the handler runs, so a handler destroying an
+ * object referenced by a later request of the same run must account
+ * for that.
+ *
+ * Only opcodes below 64 can be batched, requests creating objects
+ * cannot, and batching does not apply to resources using a view
+ * implementation.
+ *
+ * \memberof wl_resource
+ */
+WL_EXPORT int
+wl_resource_set_batch_handler(struct wl_resource *resource, uint64_t opcodes,
+			      wl_resource_batch_func_t batch)
+{
+	const struct wl_interface *interface = resource->object.interface;
+	int opcode;
+
+	if (batch == NULL) {
+		resource->batch = NULL;
+		resource->batch_opcodes = 0;
+		return 0;
+	}
+
+	for (opcode = 0; opcode < 64; opcode++) {
+		if (!(opcodes & ((uint64_t) 1 << opcode)))
+			continue;
+
+		if (opcode >= interface->method_count ||
+		    strchr(interface->methods[opcode].signature, 'n')) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	resource->batch = batch;
+	resource->batch_opcodes = opcodes;
+
+	return 0;
 }
 
 /** Create a new resource object
@@ -1899,6 +3096,11 @@ wl_resource_set_dispatcher(struct wl_resource *resource,
  * Listeners added with \a wl_client_add_resource_created_listener will be
  * notified at the end of this function.
  *
+ * The resource counts towards the WL_CLIENT_QUOTA_OBJECTS quota of the
+ * client until it is destroyed. If that quota is exceeded and its action
+ * is WL_CLIENT_QUOTA_ACTION_DISCONNECT, NULL is returned with errno set
+ * to EDQUOT and the client is sent an implementation error.
+ *
  * \memberof wl_resource
  */
 WL_EXPORT struct wl_resource *
@@ -1908,15 +3110,18 @@ wl_resource_create(struct wl_client *client,
 {
 	struct wl_resource *resource;
 
+	if (client_quota_charge(client, WL_CLIENT_QUOTA_OBJECTS, 1) < 0)
+		return NULL;
+
 	resource = zalloc(sizeof *resource);
 	if (resource == NULL)
-		return NULL;
+		goto err_quota;
 
 	if (id == 0) {
 		id = wl_map_insert_new(&client->objects, 0, NULL);
 		if (id == 0) {
-			free(resource);
-			return NULL;
+			wl_free(resource);
+			goto err_quota;
 		}
 	}
 
@@ -1926,6 +3131,7 @@ wl_resource_create(struct wl_client *client,
 
 	wl_signal_init(&resource->deprecated_destroy_signal);
 	wl_priv_signal_init(&resource->destroy_signal);
+	wl_array_init(&resource->attachments);
 
 	resource->destroy = NULL;
 	resource->client = client;
@@ -1939,12 +3145,16 @@ wl_resource_create(struct wl_client *client,
 					       WL_DISPLAY_ERROR_INVALID_OBJECT,
 					       "invalid new id %d", id);
 		}
-		free(resource);
-		return NULL;
+		wl_free(resource);
+		goto err_quota;
 	}
 
 	wl_priv_signal_emit(&client->resource_created_signal, resource);
 	return resource;
+
+err_quota:
+	client_quota_charge(client, WL_CLIENT_QUOTA_OBJECTS, -1);
+	return NULL;
 }
 
 WL_EXPORT void
@@ -1953,6 +3163,21 @@ wl_log_set_handler_server(wl_log_func_t handler)
 	wl_log_handler = handler;
 }
 
+/** Set the memory allocator of libwayland-server
+ *
+ * \param allocator The allocator to use, or NULL for the C library's
+ *
+ * Routes all memory libwayland-server allocates for itself through
+ * \c allocator, which is copied. As memory must be freed by the allocator
+ * that allocated it, this has to be called before the first display or
+ * event loop is created, and not again while any of them still exists.
+ */
+WL_EXPORT void
+wl_set_allocator_server(const struct wl_allocator *allocator)
+{
+	wl_allocator_set(allocator);
+}
+
 /** Adds a new protocol logger.
  *
  * When a new protocol message arrives or is sent from the server
@@ -2006,7 +3231,37 @@ WL_EXPORT void
 wl_protocol_logger_destroy(struct wl_protocol_logger *logger)
 {
 	wl_list_remove(&logger->link);
-	free(logger);
+	wl_free(logger);
+}
+
+/** Register a key for attaching data to resources
+ *
+ * \param display The display object
+ * \param destroy Function called for non-NULL attachments when their
+ * resource is destroyed, or NULL
+ * \return The new key, or -1 on failure
+ *
+ * Keys are small integers allocated in increasing order, valid for all
+ * resources of all clients of \a display until it is destroyed. They
+ * are meant to be registered once at startup by each module that keeps
+ * per-resource state, and used with wl_resource_set_attachment() and
+ * wl_resource_get_attachment().
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT int
+wl_display_register_resource_attachment(struct wl_display *display,
+					wl_resource_attachment_destroy_func_t destroy)
+{
+	wl_resource_attachment_destroy_func_t *p;
+
+	p = wl_priv_array_add(&display->resource_attachments, sizeof *p);
+	if (p == NULL)
+		return -1;
+
+	*p = destroy;
+
+	return (int) (display->resource_attachments.size / sizeof *p) - 1;
 }
 
 /** Add support for a wl_shm pixel format
@@ -2033,13 +3288,43 @@ wl_display_add_shm_format(struct wl_display *display, uint32_t format)
 {
 	uint32_t *p = NULL;
 
-	p = wl_array_add(&display->additional_shm_formats, sizeof *p);
+	p = wl_priv_array_add(&display->additional_shm_formats, sizeof *p);
 
 	if (p != NULL)
 		*p = format;
+	display->shm_formats_valid = false;
 	return p;
 }
 
+/** Map large wl_shm pools lazily
+ *
+ * \param display The display object
+ * \param min_pool_size Smallest pool size, in bytes, mapped lazily, or 0
+ *
+ * By default the whole of a wl_shm pool is mapped into the compositor
+ * when the pool is created, and remapped when the client resizes it.
+ * Pools created after this call whose size is at least \a min_pool_size
+ * are instead mapped in windows: each wl_shm_buffer maps only the pages
+ * it covers, windows are shared between buffers covering the same range,
+ * and a window is unmapped once the last buffer using it is destroyed.
+ * Resizing such a pool never remaps anything.
+ *
+ * While the compositor holds a reference obtained with
+ * wl_shm_buffer_ref_pool(), windows of the pool are kept mapped until the
+ * last such reference is dropped, so pointers obtained with
+ * wl_shm_buffer_get_data() stay valid as they do for fully mapped pools.
+ *
+ * Passing 0 restores the default behaviour for new pools.
+ *
+ * \memberof wl_display
+ */
+WL_EXPORT void
+wl_display_set_shm_lazy_mapping(struct wl_display *display,
+				size_t min_pool_size)
+{
+	display->shm_lazy_threshold = min_pool_size;
+}
+
 /**
  * Get list of additional wl_shm pixel formats
  *
@@ -2063,6 +3348,200 @@ wl_display_get_additional_shm_formats(struct wl_display *display)
 	return &display->additional_shm_formats;
 }
 
+static inline uint32_t
+shm_format_hash(uint32_t format, uint32_t mask)
+{
+	return (format * 2654435761u) & mask;
+}
+
+/* Formats 0 and 1 are the default ARGB8888 and XRGB8888, which are
+ * always supported and never stored in the table, so 0 marks an empty
+ * slot. */
+static int
+shm_formats_build(struct wl_display *display)
+{
+	struct wl_array *formats = &display->additional_shm_formats;
+	size_t count = formats->size / sizeof(uint32_t);
+	uint32_t size = 16, mask, *table, *event, *p, i;
+
+	while (size < count * 2)
+		size *= 2;
+	mask = size - 1;
+
+	display->shm_format_table.size = 0;
+	table = wl_priv_array_add(&display->shm_format_table,
+				  size * sizeof *table);
+	if (table == NULL)
+		return -1;
+	memset(table, 0, size * sizeof *table);
+
+	wl_array_for_each(p, formats) {
+		if (*p <= WL_SHM_FORMAT_XRGB8888)
+			continue;
+		for (i = shm_format_hash(*p, mask);
+		     table[i] != 0 && table[i] != *p;
+		     i = (i + 1) & mask)
+			;
+		table[i] = *p;
+	}
+
+	/* One event per format, as bind_shm() used to send them. The
+	 * sender id is filled in for each wl_shm resource. */
+	display->shm_format_events.size = 0;
+	event = wl_priv_array_add(&display->shm_format_events,
+				  (count + 2) * 3 * sizeof *event);
+	if (event == NULL)
+		return -1;
+
+	for (i = 0; i < count + 2; i++) {
+		event[i * 3 + 1] = (3 * sizeof *event) << 16 |
+				   WL_SHM_FORMAT;
+		if (i < 2)
+			event[i * 3 + 2] = i == 0 ? WL_SHM_FORMAT_ARGB8888 :
+						    WL_SHM_FORMAT_XRGB8888;
+		else
+			event[i * 3 + 2] = ((uint32_t *) formats->data)[i - 2];
+	}
+
+	display->shm_formats_size = formats->size;
+	display->shm_formats_valid = true;
+
+	return 0;
+}
+
+static bool
+shm_formats_update(struct wl_display *display)
+{
+	if (display->shm_formats_valid &&
+	    display->shm_formats_size == display->additional_shm_formats.size)
+		return true;
+
+	return shm_formats_build(display) == 0;
+}
+
+/* Formats may be changed through the pointer returned by
+ * wl_display_add_shm_format() without the display noticing, so check
+ * the pre-serialized events against the array before sending them. */
+static bool
+shm_formats_current(struct wl_display *display)
+{
+	uint32_t *event = display->shm_format_events.data;
+	uint32_t *formats = display->additional_shm_formats.data;
+	size_t i, count;
+
+	count = display->additional_shm_formats.size / sizeof *formats;
+	for (i = 0; i < count; i++)
+		if (event[(i + 2) * 3 + 2] != formats[i])
+			return false;
+
+	return true;
+}
+
+/** Check whether a wl_shm format is supported
+ *
+ * \param display The display object
+ * \param format The wl_shm format
+ * \return Whether \a format is the default ARGB8888 or XRGB8888 format or
+ * was added with wl_display_add_shm_format()
+ *
+ * \private
+ *
+ * \memberof wl_display
+ */
+bool
+wl_display_shm_format_is_supported(struct wl_display *display,
+				   uint32_t format)
+{
+	uint32_t *table, mask, i, *p;
+
+	if (format <= WL_SHM_FORMAT_XRGB8888)
+		return true;
+
+	if (shm_formats_update(display)) {
+		table = display->shm_format_table.data;
+		mask = display->shm_format_table.size / sizeof *table - 1;
+		for (i = shm_format_hash(format, mask); table[i] != 0;
+		     i = (i + 1) & mask)
+			if (table[i] == format)
+				return true;
+	}
+
+	/* A format may also have been set through the pointer returned
+	 * by wl_display_add_shm_format() after the table was built. */
+	wl_array_for_each(p, &display->additional_shm_formats)
+		if (*p == format)
+			return true;
+
+	return false;
+}
+
+/** Send a wl_shm.format event for every supported format
+ *
+ * \param display The display object
+ * \param resource A wl_shm resource
+ *
+ * The events are copied from a pre-serialized buffer that is rebuilt
+ * when the set of formats changes, and queued in chunks no larger than
+ * the connection's buffer. When they need to be logged they are sent
+ * one by one instead.
+ *
+ * \private
+ *
+ * \memberof wl_display
+ */
+void
+wl_display_send_shm_formats(struct wl_display *display,
+			    struct wl_resource *resource)
+{
+	struct wl_client *client = resource->client;
+	const size_t chunk = WL_CONNECTION_BUFFER_SIZE / (3 * sizeof(uint32_t));
+	uint32_t *event, *p;
+	size_t i, n, count;
+
+	if (client->error)
+		return;
+
+	if (debug_server || !wl_list_empty(&display->protocol_loggers) ||
+	    !shm_formats_update(display) ||
+	    (!shm_formats_current(display) &&
+	     shm_formats_build(display) < 0)) {
+		wl_shm_send_format(resource, WL_SHM_FORMAT_ARGB8888);
+		wl_shm_send_format(resource, WL_SHM_FORMAT_XRGB8888);
+		wl_array_for_each(p, &display->additional_shm_formats)
+			wl_shm_send_format(resource, *p);
+		return;
+	}
+
+	event = display->shm_format_events.data;
+	count = display->shm_format_events.size / (3 * sizeof *event);
+	for (i = 0; i < count; i++)
+		event[i * 3] = resource->object.id;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < chunk ? count - i : chunk;
+		if (wl_connection_write(client->connection, event + i * 3,
+					n * 3 * sizeof *event) < 0) {
+			client->error = 1;
+			return;
+		}
+	}
+}
+
+/** Get the minimum size of lazily mapped wl_shm pools
+ *
+ * \param display The display object
+ * \return The threshold set with wl_display_set_shm_lazy_mapping()
+ *
+ * \private
+ *
+ * \memberof wl_display
+ */
+size_t
+wl_display_get_shm_lazy_threshold(struct wl_display *display)
+{
+	return display->shm_lazy_threshold;
+}
+
 /** Get the list of currently connected clients
  *
  * \param display The display object
@@ -58,6 +58,15 @@ static pthread_once_t wl_shm_sigbus_once = PTHREAD_ONCE_INIT;
 static pthread_key_t wl_shm_sigbus_data_key;
 static struct sigaction wl_shm_old_sigbus_action;
 
+/* A part of a lazily mapped pool, shared by the buffers it covers. */
+struct shm_window {
+	struct wl_list link;
+	off_t offset;
+	size_t length;
+	char *data;
+	int refcount;
+};
+
 struct wl_shm_pool {
 	struct wl_resource *resource;
 	int internal_refcount;
@@ -65,6 +74,13 @@ struct wl_shm_pool {
 	char *data;
 	ssize_t size;
 	ssize_t new_size;
+	/* Lazy pools keep the fd and map only what buffers use. */
+	bool lazy;
+	int fd;
+	struct wl_list windows;
+	/* Charged to the client quotas while the resource is alive */
+	int64_t quota_bytes;
+	int64_t quota_fds;
 #ifndef MREMAP_MAYMOVE
 	/* The following three fields are needed for mremap() emulation. */
 	int mmap_fd;
@@ -90,6 +106,7 @@ struct wl_shm_buffer {
 	uint32_t format;
 	int offset;
 	struct wl_shm_pool *pool;
+	struct shm_window *window;
 };
 
 struct wl_shm_sigbus_data {
@@ -98,6 +115,79 @@ struct wl_shm_sigbus_data {
 	int fallback_mapping_used;
 };
 
+static struct shm_window *
+shm_pool_get_window(struct wl_shm_pool *pool, int32_t offset, int32_t length)
+{
+	static long page_size;
+	struct shm_window *window;
+	off_t start;
+	size_t size;
+
+	if (page_size == 0)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	start = offset & ~((off_t) page_size - 1);
+	size = (offset + length - start + page_size - 1) &
+		~((size_t) page_size - 1);
+
+	wl_list_for_each(window, &pool->windows, link) {
+		if (window->offset <= start &&
+		    window->offset + window->length >= start + size) {
+			window->refcount++;
+			return window;
+		}
+	}
+
+	window = zalloc(sizeof *window);
+	if (window == NULL)
+		return NULL;
+
+	window->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    pool->fd, start);
+	if (window->data == MAP_FAILED) {
+		wl_free(window);
+		return NULL;
+	}
+
+	window->offset = start;
+	window->length = size;
+	window->refcount = 1;
+	wl_list_insert(&pool->windows, &window->link);
+
+	return window;
+}
+
+static void
+shm_window_destroy(struct shm_window *window)
+{
+	munmap(window->data, window->length);
+	wl_list_remove(&window->link);
+	wl_free(window);
+}
+
+/* Unmap the windows no buffer uses anymore. Pointers into them may be
+ * cached by the compositor while it holds external references, so
+ * this waits until those are gone. */
+static void
+shm_pool_trim_windows(struct wl_shm_pool *pool)
+{
+	struct shm_window *window, *next;
+
+	wl_list_for_each_safe(window, next, &pool->windows, link)
+		if (window->refcount == 0)
+			shm_window_destroy(window);
+}
+
+static void
+shm_window_unref(struct wl_shm_pool *pool, struct shm_window *window)
+{
+	window->refcount--;
+	assert(window->refcount >= 0);
+
+	if (window->refcount == 0 && pool->external_refcount == 0)
+		shm_window_destroy(window);
+}
+
 static void *
 shm_pool_grow_mapping(struct wl_shm_pool *pool)
 {
@@ -126,6 +216,11 @@ shm_pool_finish_resize(struct wl_shm_pool *pool)
 	if (pool->size == pool->new_size)
 		return;
 
+	if (pool->lazy) {
+		pool->size = pool->new_size;
+		return;
+	}
+
 	data = shm_pool_grow_mapping(pool);
 	if (data == MAP_FAILED) {
 		if (pool->resource != NULL)
@@ -145,8 +240,10 @@ shm_pool_unref(struct wl_shm_pool *pool, bool external)
 	if (external) {
 		pool->external_refcount--;
 		assert(pool->external_refcount >= 0);
-		if (pool->external_refcount == 0)
+		if (pool->external_refcount == 0) {
 			shm_pool_finish_resize(pool);
+			shm_pool_trim_windows(pool);
+		}
 	} else {
 		pool->internal_refcount--;
 		assert(pool->internal_refcount >= 0);
@@ -155,11 +252,17 @@ shm_pool_unref(struct wl_shm_pool *pool, bool external)
 	if (pool->internal_refcount + pool->external_refcount > 0)
 		return;
 
-	munmap(pool->data, pool->size);
+	if (pool->lazy) {
+		shm_pool_trim_windows(pool);
+		assert(wl_list_empty(&pool->windows));
+		close(pool->fd);
+	} else {
+		munmap(pool->data, pool->size);
 #ifndef MREMAP_MAYMOVE
-	close(pool->mmap_fd);
+		close(pool->mmap_fd);
 #endif
-	free(pool);
+	}
+	wl_free(pool);
 }
 
 static void
@@ -167,8 +270,10 @@ destroy_buffer(struct wl_resource *resource)
 {
 	struct wl_shm_buffer *buffer = wl_resource_get_user_data(resource);
 
+	if (buffer->window)
+		shm_window_unref(buffer->pool, buffer->window);
 	shm_pool_unref(buffer->pool, false);
-	free(buffer);
+	wl_free(buffer);
 }
 
 static void
@@ -184,22 +289,8 @@ static const struct wl_buffer_interface shm_buffer_interface = {
 static bool
 format_is_supported(struct wl_client *client, uint32_t format)
 {
-	struct wl_display *display = wl_client_get_display(client);
-	struct wl_array *formats;
-	uint32_t *p;
-
-	switch (format) {
-	case WL_SHM_FORMAT_ARGB8888:
-	case WL_SHM_FORMAT_XRGB8888:
-		return true;
-	default:
-		formats = wl_display_get_additional_shm_formats(display);
-		wl_array_for_each(p, formats)
-			if (*p == format)
-				return true;
-	}
-
-	return false;
+	return wl_display_shm_format_is_supported(wl_client_get_display(client),
+						  format);
 }
 
 static void
@@ -234,6 +325,19 @@ shm_pool_create_buffer(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	if (pool->lazy) {
+		buffer->window = shm_pool_get_window(pool, offset,
+						     stride * height);
+		if (buffer->window == NULL) {
+			wl_resource_post_error(resource,
+					       WL_SHM_ERROR_INVALID_FD,
+					       "failed mmap: %s",
+					       strerror(errno));
+			wl_free(buffer);
+			return;
+		}
+	}
+
 	buffer->width = width;
 	buffer->height = height;
 	buffer->format = format;
@@ -246,8 +350,10 @@ shm_pool_create_buffer(struct wl_client *client, struct wl_resource *resource,
 		wl_resource_create(client, &wl_buffer_interface, 1, id);
 	if (buffer->resource == NULL) {
 		wl_client_post_no_memory(client);
+		if (buffer->window)
+			shm_window_unref(pool, buffer->window);
 		shm_pool_unref(pool, false);
-		free(buffer);
+		wl_free(buffer);
 		return;
 	}
 
@@ -260,6 +366,11 @@ static void
 destroy_pool(struct wl_resource *resource)
 {
 	struct wl_shm_pool *pool = wl_resource_get_user_data(resource);
+	struct wl_client *client = wl_resource_get_client(resource);
+
+	wl_client_quota_charge(client, WL_CLIENT_QUOTA_SHM_BYTES,
+			       -pool->quota_bytes);
+	wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, -pool->quota_fds);
 
 	pool->resource = NULL;
 	shm_pool_unref(pool, false);
@@ -284,6 +395,11 @@ shm_pool_resize(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	if (wl_client_quota_charge(client, WL_CLIENT_QUOTA_SHM_BYTES,
+				   size - pool->quota_bytes) < 0)
+		return;
+	pool->quota_bytes = size;
+
 	pool->new_size = size;
 
 	/* If the compositor has taken references on this pool it
@@ -305,8 +421,11 @@ static void
 shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 		uint32_t id, int fd, int32_t size)
 {
+	struct wl_display *display = wl_client_get_display(client);
 	struct wl_shm_pool *pool;
 	struct stat statbuf;
+	size_t threshold;
+	int64_t fds;
 	int seals;
 	int prot;
 	int flags;
@@ -341,6 +460,32 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 	pool->external_refcount = 0;
 	pool->size = size;
 	pool->new_size = size;
+	wl_list_init(&pool->windows);
+
+	threshold = wl_display_get_shm_lazy_threshold(display);
+	if (threshold > 0 && (size_t) size >= threshold)
+		pool->lazy = true;
+
+	/* Lazy pools, and all pools without mremap(), keep the fd open */
+#ifdef MREMAP_MAYMOVE
+	fds = pool->lazy ? 1 : 0;
+#else
+	fds = 1;
+#endif
+
+	if (wl_client_quota_charge(client, WL_CLIENT_QUOTA_SHM_BYTES,
+				   size) < 0)
+		goto err_free;
+	pool->quota_bytes = size;
+	if (wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, fds) < 0)
+		goto err_quota;
+	pool->quota_fds = fds;
+
+	if (pool->lazy) {
+		pool->fd = fd;
+		goto create_resource;
+	}
+
 	prot = PROT_READ | PROT_WRITE;
 	flags = MAP_SHARED;
 	pool->data = mmap(NULL, size, prot, flags, fd, 0);
@@ -348,7 +493,7 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 		wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_FD,
 				       "failed mmap fd %d: %s", fd,
 				       strerror(errno));
-		goto err_free;
+		goto err_quota;
 	}
 #ifndef MREMAP_MAYMOVE
 	/* We may need to keep the fd, prot and flags to emulate mremap(). */
@@ -358,12 +503,22 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 #else
 	close(fd);
 #endif
+
+create_resource:
 	pool->resource =
 		wl_resource_create(client, &wl_shm_pool_interface, 1, id);
 	if (!pool->resource) {
-		wl_client_post_no_memory(client);
-		munmap(pool->data, pool->size);
-		free(pool);
+		if (errno != EDQUOT)
+			wl_client_post_no_memory(client);
+		wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS,
+				       -pool->quota_fds);
+		wl_client_quota_charge(client, WL_CLIENT_QUOTA_SHM_BYTES,
+				       -pool->quota_bytes);
+		if (pool->lazy)
+			close(fd);
+		else
+			munmap(pool->data, pool->size);
+		wl_free(pool);
 		return;
 	}
 
@@ -373,8 +528,12 @@ shm_create_pool(struct wl_client *client, struct wl_resource *resource,
 
 	return;
 
+err_quota:
+	wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, -pool->quota_fds);
+	wl_client_quota_charge(client, WL_CLIENT_QUOTA_SHM_BYTES,
+			       -pool->quota_bytes);
 err_free:
-	free(pool);
+	wl_free(pool);
 err_close:
 	close(fd);
 }
@@ -389,8 +548,6 @@ bind_shm(struct wl_client *client,
 {
 	struct wl_resource *resource;
 	struct wl_display *display = wl_client_get_display(client);
-	struct wl_array *additional_formats;
-	uint32_t *p;
 
 	resource = wl_resource_create(client, &wl_shm_interface, 1, id);
 	if (!resource) {
@@ -400,12 +557,7 @@ bind_shm(struct wl_client *client,
 
 	wl_resource_set_implementation(resource, &shm_interface, data, NULL);
 
-	wl_shm_send_format(resource, WL_SHM_FORMAT_ARGB8888);
-	wl_shm_send_format(resource, WL_SHM_FORMAT_XRGB8888);
-
-	additional_formats = wl_display_get_additional_shm_formats(display);
-	wl_array_for_each(p, additional_formats)
-		wl_shm_send_format(resource, *p);
+	wl_display_send_shm_formats(display, resource);
 }
 
 WL_EXPORT int
@@ -456,6 +608,10 @@ wl_shm_buffer_get_stride(struct wl_shm_buffer *buffer)
 WL_EXPORT void *
 wl_shm_buffer_get_data(struct wl_shm_buffer *buffer)
 {
+	if (buffer->window)
+		return buffer->window->data +
+			(buffer->offset - buffer->window->offset);
+
 	if (buffer->pool->external_refcount &&
 	    (buffer->pool->size != buffer->pool->new_size))
 		wl_log("Buffer address requested when its parent pool "
@@ -535,12 +691,38 @@ reraise_sigbus(void)
 	raise(SIGBUS);
 }
 
+static bool
+shm_pool_find_mapping(struct wl_shm_pool *pool, char *addr,
+		      char **data, size_t *size)
+{
+	struct shm_window *window;
+
+	if (!pool->lazy) {
+		*data = pool->data;
+		*size = pool->size;
+		return addr >= pool->data && addr < pool->data + pool->size;
+	}
+
+	wl_list_for_each(window, &pool->windows, link) {
+		if (addr >= window->data &&
+		    addr < window->data + window->length) {
+			*data = window->data;
+			*size = window->length;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static void
 sigbus_handler(int signum, siginfo_t *info, void *context)
 {
 	struct wl_shm_sigbus_data *sigbus_data =
 		pthread_getspecific(wl_shm_sigbus_data_key);
 	struct wl_shm_pool *pool;
+	char *data;
+	size_t size;
 
 	if (sigbus_data == NULL) {
 		reraise_sigbus();
@@ -553,8 +735,7 @@ sigbus_handler(int signum, siginfo_t *info, void *context)
 	 * the pool then the error is a real problem so we'll reraise
 	 * the signal */
 	if (pool == NULL ||
-	    (char *) info->si_addr < pool->data ||
-	    (char *) info->si_addr >= pool->data + pool->size) {
+	    !shm_pool_find_mapping(pool, info->si_addr, &data, &size)) {
 		reraise_sigbus();
 		return;
 	}
@@ -562,7 +743,7 @@ sigbus_handler(int signum, siginfo_t *info, void *context)
 	sigbus_data->fallback_mapping_used = 1;
 
 	/* This should replace the previous mapping */
-	if (mmap(pool->data, pool->size, PROT_READ | PROT_WRITE,
+	if (mmap(data, size, PROT_READ | PROT_WRITE,
 		 MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, 0, 0) == MAP_FAILED) {
 		reraise_sigbus();
 		return;
@@ -574,7 +755,7 @@ destroy_sigbus_data(void *data)
 {
 	struct wl_shm_sigbus_data *sigbus_data = data;
 
-	free(sigbus_data);
+	wl_free(sigbus_data);
 }
 
 static void
@@ -25,6 +25,7 @@
  */
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -93,21 +94,60 @@ wl_list_insert_list(struct wl_list *list, struct wl_list *other)
 	list->next = other->next;
 }
 
+static void *
+wl_default_alloc(void *data, size_t size)
+{
+	return malloc(size);
+}
+
+static void *
+wl_default_realloc(void *data, void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void
+wl_default_free(void *data, void *ptr)
+{
+	free(ptr);
+}
+
+static const struct wl_allocator wl_default_allocator = {
+	wl_default_alloc,
+	wl_default_realloc,
+	wl_default_free,
+	NULL
+};
+
+struct wl_allocator wl_allocator_active = {
+	wl_default_alloc,
+	wl_default_realloc,
+	wl_default_free,
+	NULL
+};
+
+void
+wl_allocator_set(const struct wl_allocator *allocator)
+{
+	wl_allocator_active = allocator ? *allocator : wl_default_allocator;
+}
+
 WL_EXPORT void
 wl_array_init(struct wl_array *array)
 {
 	memset(array, 0, sizeof *array);
 }
 
-WL_EXPORT void
-wl_array_release(struct wl_array *array)
+static void
+array_release(struct wl_array *array, const struct wl_allocator *allocator)
 {
-	free(array->data);
+	allocator->free(allocator->data, array->data);
 	array->data = WL_ARRAY_POISON_PTR;
 }
 
-WL_EXPORT void *
-wl_array_add(struct wl_array *array, size_t size)
+static void *
+array_add(struct wl_array *array, size_t size,
+	  const struct wl_allocator *allocator)
 {
 	size_t alloc;
 	void *data, *p;
@@ -122,9 +162,10 @@ wl_array_add(struct wl_array *array, size_t size)
 
 	if (array->alloc < alloc) {
 		if (array->alloc > 0)
-			data = realloc(array->data, alloc);
+			data = allocator->realloc(allocator->data,
+						  array->data, alloc);
 		else
-			data = malloc(alloc);
+			data = allocator->alloc(allocator->data, alloc);
 
 		if (data == NULL)
 			return NULL;
@@ -138,6 +179,35 @@ wl_array_add(struct wl_array *array, size_t size)
 	return p;
 }
 
+/* The exported wl_array functions resolve to a single copy when both
+ * libwayland-client and libwayland-server are loaded, so they cannot
+ * know which library's allocator applies, and the arrays they are
+ * given belong to the application. They keep using the C library. */
+
+WL_EXPORT void
+wl_array_release(struct wl_array *array)
+{
+	array_release(array, &wl_default_allocator);
+}
+
+WL_EXPORT void *
+wl_array_add(struct wl_array *array, size_t size)
+{
+	return array_add(array, size, &wl_default_allocator);
+}
+
+void
+wl_priv_array_release(struct wl_array *array)
+{
+	array_release(array, &wl_allocator_active);
+}
+
+void *
+wl_priv_array_add(struct wl_array *array, size_t size)
+{
+	return array_add(array, size, &wl_allocator_active);
+}
+
 WL_EXPORT int
 wl_array_copy(struct wl_array *array, struct wl_array *source)
 {
@@ -178,22 +248,149 @@ union map_entry {
 #define map_entry_get_data(entry) ((void *)((entry).next & ~(uintptr_t)0x3))
 #define map_entry_get_flags(entry) (((entry).next >> 1) & 0x1)
 
+/* Number of entries sharing a 64 byte cache line */
+#define MAP_LINE_ENTRIES (64 / sizeof(union map_entry))
+
+/* Marks an empty lookup cache slot.  This is above the highest id a map
+ * can hold, so looking it up yields the NULL entry of an empty slot. */
+#define MAP_CACHE_EMPTY UINT32_MAX
+
+static struct wl_array *
+map_get_entries(struct wl_map *map, uint32_t *i)
+{
+	if (*i < WL_SERVER_ID_START)
+		return &map->client_entries;
+
+	*i -= WL_SERVER_ID_START;
+	return &map->server_entries;
+}
+
+static inline void
+map_cache_invalidate(struct wl_map *map, uint32_t id)
+{
+	struct wl_map_cache_slot *slot =
+		&map->cache[id & (WL_MAP_CACHE_SIZE - 1)];
+
+	if (slot->id == id) {
+		slot->id = MAP_CACHE_EMPTY;
+		slot->entry = 0;
+	}
+}
+
+static int
+map_set_free(struct wl_map *map, uint32_t i)
+{
+	uint64_t *words;
+	size_t count = i / 64 + 1;
+	size_t size = map->free_bits.size / sizeof *words;
+
+	if (size < count) {
+		words = wl_priv_array_add(&map->free_bits,
+					  (count - size) * sizeof *words);
+		if (!words)
+			return -1;
+		memset(words, 0, (count - size) * sizeof *words);
+	}
+
+	words = map->free_bits.data;
+	words[i / 64] |= UINT64_C(1) << (i % 64);
+	map->free_count++;
+	map->hint = i;
+
+	return 0;
+}
+
+static inline uint64_t
+map_line_mask(uint32_t i)
+{
+	return ((UINT64_C(1) << MAP_LINE_ENTRIES) - 1) <<
+		(i % 64 & ~(MAP_LINE_ENTRIES - 1));
+}
+
+/* Take a free entry for a new object.  Entries sharing a cache line with
+ * near, the object the new one is created from, come first, then the most
+ * recently freed entry and the entries in its line, then the closest free
+ * entry after it. */
+static uint32_t
+map_take_free(struct wl_map *map, uint32_t near)
+{
+	uint64_t *words = map->free_bits.data;
+	size_t size = map->free_bits.size / sizeof *words;
+	size_t w, k;
+	uint64_t bits;
+	uint32_t bit, i;
+
+	w = near / 64;
+	if (w < size) {
+		bits = words[w] & map_line_mask(near);
+		if (bits) {
+			bit = __builtin_ctzll(bits);
+			goto found;
+		}
+	}
+
+	w = map->hint / 64;
+	bit = map->hint % 64;
+	if (w < size) {
+		if (words[w] & (UINT64_C(1) << bit))
+			goto found;
+		bits = words[w] & map_line_mask(map->hint);
+		if (bits) {
+			bit = __builtin_ctzll(bits);
+			goto found;
+		}
+	} else {
+		w = 0;
+	}
+
+	for (k = 0; k < size; k++, w = (w + 1) % size) {
+		if (words[w]) {
+			bit = __builtin_ctzll(words[w]);
+			goto found;
+		}
+	}
+
+	/* free_count and free_bits disagree */
+	abort();
+
+found:
+	words[w] &= ~(UINT64_C(1) << bit);
+	map->free_count--;
+	i = w * 64 + bit;
+	map->hint = i;
+
+	return i;
+}
+
 void
 wl_map_init(struct wl_map *map, uint32_t side)
 {
+	int i;
+
 	memset(map, 0, sizeof *map);
 	map->side = side;
+	for (i = 0; i < WL_MAP_CACHE_SIZE; i++)
+		map->cache[i].id = MAP_CACHE_EMPTY;
 }
 
 void
 wl_map_release(struct wl_map *map)
 {
-	wl_array_release(&map->client_entries);
-	wl_array_release(&map->server_entries);
+	wl_priv_array_release(&map->client_entries);
+	wl_priv_array_release(&map->server_entries);
+	wl_priv_array_release(&map->free_bits);
 }
 
 uint32_t
 wl_map_insert_new(struct wl_map *map, uint32_t flags, void *data)
+{
+	/* Not a valid id, so there is no line to prefer */
+	return wl_map_insert_near(map, flags, data, UINT32_MAX);
+}
+
+uint32_t
+wl_map_insert_near(struct wl_map *map, uint32_t flags, void *data,
+		   uint32_t near)
 {
 	union map_entry *start, *entry;
 	struct wl_array *entries;
@@ -208,15 +405,18 @@ wl_map_insert_new(struct wl_map *map, uint32_t flags, void *data)
 		base = WL_SERVER_ID_START;
 	}
 
-	if (map->free_list) {
+	if (map->free_count) {
+		/* Ids from the other side wrap around past the end of
+		 * free_bits and have no line to prefer */
+		near -= base;
 		start = entries->data;
-		entry = &start[map->free_list >> 1];
-		map->free_list = entry->next;
+		entry = &start[map_take_free(map, near)];
 	} else {
-		entry = wl_array_add(entries, sizeof *entry);
+		entry = wl_priv_array_add(entries, sizeof *entry);
 		if (!entry)
 			return 0;
 		start = entries->data;
+		map->hint = entry - start;
 	}
 
 	/* wl_array only grows, so if we have too many objects at
@@ -237,6 +437,7 @@ wl_map_insert_new(struct wl_map *map, uint32_t flags, void *data)
 	}
 	entry->data = data;
 	entry->next |= (flags & 0x1) << 1;
+	map_cache_invalidate(map, count + base);
 
 	return count + base;
 }
@@ -245,15 +446,10 @@ int
 wl_map_insert_at(struct wl_map *map, uint32_t flags, uint32_t i, void *data)
 {
 	union map_entry *start;
-	uint32_t count;
+	uint32_t count, id = i;
 	struct wl_array *entries;
 
-	if (i < WL_SERVER_ID_START) {
-		entries = &map->client_entries;
-	} else {
-		entries = &map->server_entries;
-		i -= WL_SERVER_ID_START;
-	}
+	entries = map_get_entries(map, &i);
 
 	if (i > WL_MAP_MAX_OBJECTS) {
 		errno = ENOSPC;
@@ -267,13 +463,14 @@ wl_map_insert_at(struct wl_map *map, uint32_t flags, uint32_t i, void *data)
 	}
 
 	if (count == i) {
-		if (!wl_array_add(entries, sizeof *start))
+		if (!wl_priv_array_add(entries, sizeof *start))
 			return -1;
 	}
 
 	start = entries->data;
 	start[i].data = data;
 	start[i].next |= (flags & 0x1) << 1;
+	map_cache_invalidate(map, id);
 
 	return 0;
 }
@@ -282,7 +479,7 @@ int
 wl_map_reserve_new(struct wl_map *map, uint32_t i)
 {
 	union map_entry *start;
-	uint32_t count;
+	uint32_t count, id = i;
 	struct wl_array *entries;
 
 	if (i < WL_SERVER_ID_START) {
@@ -314,11 +511,12 @@ wl_map_reserve_new(struct wl_map *map, uint32_t i)
 	}
 
 	if (count == i) {
-		if (!wl_array_add(entries, sizeof *start))
+		if (!wl_priv_array_add(entries, sizeof *start))
 			return -1;
 
 		start = entries->data;
 		start[i].data = NULL;
+		map_cache_invalidate(map, id);
 	} else {
 		start = entries->data;
 		if (start[i].data != NULL) {
@@ -335,6 +533,7 @@ wl_map_remove(struct wl_map *map, uint32_t i)
 {
 	union map_entry *start;
 	struct wl_array *entries;
+	uint32_t id = i;
 
 	if (i < WL_SERVER_ID_START) {
 		if (map->side == WL_MAP_SERVER_SIDE)
@@ -349,30 +548,49 @@ wl_map_remove(struct wl_map *map, uint32_t i)
 		i -= WL_SERVER_ID_START;
 	}
 
+	/* If the free bitmap can't grow the id is never handed out
+	 * again, but the entry still reads as free. */
 	start = entries->data;
-	start[i].next = map->free_list;
-	map->free_list = (i << 1) | 1;
+	start[i].next = 0x1;
+	map_set_free(map, i);
+	map_cache_invalidate(map, id);
 }
 
-void *
-wl_map_lookup(struct wl_map *map, uint32_t i)
+static bool
+map_lookup_entry(struct wl_map *map, uint32_t id, union map_entry *entry)
 {
+	struct wl_map_cache_slot *slot =
+		&map->cache[id & (WL_MAP_CACHE_SIZE - 1)];
 	union map_entry *start;
-	uint32_t count;
 	struct wl_array *entries;
+	uint32_t count, i = id;
 
-	if (i < WL_SERVER_ID_START) {
-		entries = &map->client_entries;
-	} else {
-		entries = &map->server_entries;
-		i -= WL_SERVER_ID_START;
+	if (slot->id == id) {
+		entry->next = slot->entry;
+		return true;
 	}
 
+	entries = map_get_entries(map, &i);
 	start = entries->data;
 	count = entries->size / sizeof *start;
 
-	if (i < count && !map_entry_is_free(start[i]))
-		return map_entry_get_data(start[i]);
+	if (i >= count || map_entry_is_free(start[i]))
+		return false;
+
+	*entry = start[i];
+	slot->id = id;
+	slot->entry = entry->next;
+
+	return true;
+}
+
+void *
+wl_map_lookup(struct wl_map *map, uint32_t i)
+{
+	union map_entry entry;
+
+	if (map_lookup_entry(map, i, &entry))
+		return map_entry_get_data(entry);
 
 	return NULL;
 }
@@ -380,28 +598,17 @@ wl_map_lookup(struct wl_map *map, uint32_t i)
 uint32_t
 wl_map_lookup_flags(struct wl_map *map, uint32_t i)
 {
-	union map_entry *start;
-	uint32_t count;
-	struct wl_array *entries;
-
-	if (i < WL_SERVER_ID_START) {
-		entries = &map->client_entries;
-	} else {
-		entries = &map->server_entries;
-		i -= WL_SERVER_ID_START;
-	}
+	union map_entry entry;
 
-	start = entries->data;
-	count = entries->size / sizeof *start;
-
-	if (i < count && !map_entry_is_free(start[i]))
-		return map_entry_get_flags(start[i]);
+	if (map_lookup_entry(map, i, &entry))
+		return map_entry_get_flags(entry);
 
 	return 0;
 }
 
 static enum wl_iterator_result
-for_each_helper(struct wl_array *entries, wl_iterator_func_t func, void *data)
+for_each_helper(struct wl_array *entries, size_t *idx,
+		wl_iterator_func_t func, void *data)
 {
 	enum wl_iterator_result ret = WL_ITERATOR_CONTINUE;
 	union map_entry entry, *start;
@@ -410,8 +617,8 @@ for_each_helper(struct wl_array *entries, wl_iterator_func_t func, void *data)
 	start = (union map_entry *) entries->data;
 	count = entries->size / sizeof(union map_entry);
 
-	for (size_t idx = 0; idx < count; idx++) {
-		entry = start[idx];
+	for (; *idx < count; (*idx)++) {
+		entry = start[*idx];
 		if (entry.data && !map_entry_is_free(entry)) {
 			ret = func(map_entry_get_data(entry), data, map_entry_get_flags(entry));
 			if (ret != WL_ITERATOR_CONTINUE)
@@ -424,12 +631,35 @@ for_each_helper(struct wl_array *entries, wl_iterator_func_t func, void *data)
 
 void
 wl_map_for_each(struct wl_map *map, wl_iterator_func_t func, void *data)
+{
+	uint32_t next = 0;
+
+	wl_map_for_each_from(map, &next, func, data);
+}
+
+/* Like wl_map_for_each(), but starts at the entry with id *next. When
+ * func stops the iteration, *next is left at the id of the entry it
+ * stopped at, otherwise at an id past the last entry. */
+void
+wl_map_for_each_from(struct wl_map *map, uint32_t *next,
+		     wl_iterator_func_t func, void *data)
 {
 	enum wl_iterator_result ret;
+	size_t idx;
+
+	if (*next < WL_SERVER_ID_START) {
+		idx = *next;
+		ret = for_each_helper(&map->client_entries, &idx, func, data);
+		if (ret != WL_ITERATOR_CONTINUE) {
+			*next = idx;
+			return;
+		}
+		*next = WL_SERVER_ID_START;
+	}
 
-	ret = for_each_helper(&map->client_entries, func, data);
-	if (ret == WL_ITERATOR_CONTINUE)
-		for_each_helper(&map->server_entries, func, data);
+	idx = *next - WL_SERVER_ID_START;
+	for_each_helper(&map->server_entries, &idx, func, data);
+	*next = WL_SERVER_ID_START + idx;
 }
 
 static void
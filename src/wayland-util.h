@@ -593,6 +593,107 @@ wl_array_copy(struct wl_array *array, struct wl_array *source);
 	     (const char *) pos < ((const char *) (array)->data + (array)->size); \
 	     (pos)++)
 
+#ifdef WL_INLINE_FAST_PATHS
+/*
+ * Inline fast paths
+ *
+ * Defining WL_INLINE_FAST_PATHS before including this header replaces
+ * calls to the wl_list functions, wl_array_init() and wl_array_add()
+ * with inline versions, avoiding a call through the PLT for each of
+ * them. wl_array_add() only falls back to the library when the array
+ * has to grow or has not allocated yet. The exported functions stay available, e.g. when taking
+ * their address.
+ */
+
+static inline void
+wl_list_init_inline(struct wl_list *list)
+{
+	list->prev = list;
+	list->next = list;
+}
+
+static inline void
+wl_list_insert_inline(struct wl_list *list, struct wl_list *elm)
+{
+	elm->prev = list;
+	elm->next = list->next;
+	list->next = elm;
+	elm->next->prev = elm;
+}
+
+static inline void
+wl_list_remove_inline(struct wl_list *elm)
+{
+	elm->prev->next = elm->next;
+	elm->next->prev = elm->prev;
+	elm->next = NULL;
+	elm->prev = NULL;
+}
+
+static inline int
+wl_list_length_inline(const struct wl_list *list)
+{
+	struct wl_list *e;
+	int count = 0;
+
+	for (e = list->next; e != list; e = e->next)
+		count++;
+
+	return count;
+}
+
+static inline int
+wl_list_empty_inline(const struct wl_list *list)
+{
+	return list->next == list;
+}
+
+static inline void
+wl_list_insert_list_inline(struct wl_list *list, struct wl_list *other)
+{
+	if (other->next == other)
+		return;
+
+	other->next->prev = list;
+	other->prev->next = list->next;
+	list->next->prev = other->prev;
+	list->next = other->next;
+}
+
+static inline void
+wl_array_init_inline(struct wl_array *array)
+{
+	array->size = 0;
+	array->alloc = 0;
+	array->data = NULL;
+}
+
+static inline void *
+wl_array_add_inline(struct wl_array *array, size_t size)
+{
+	void *p;
+
+	/* An array without storage has no pointer to return yet, even
+	 * for size 0 */
+	if (array->alloc == 0 || array->alloc - array->size < size)
+		return wl_array_add(array, size);
+
+	p = (char *) array->data + array->size;
+	array->size += size;
+
+	return p;
+}
+
+#define wl_list_init(list) wl_list_init_inline(list)
+#define wl_list_insert(list, elm) wl_list_insert_inline(list, elm)
+#define wl_list_remove(elm) wl_list_remove_inline(elm)
+#define wl_list_length(list) wl_list_length_inline(list)
+#define wl_list_empty(list) wl_list_empty_inline(list)
+#define wl_list_insert_list(list, other) wl_list_insert_list_inline(list, other)
+#define wl_array_init(array) wl_array_init_inline(array)
+#define wl_array_add(array, size) wl_array_add_inline(array, size)
+#endif /* WL_INLINE_FAST_PATHS */
+
 /**
  * Fixed-point number
  *
@@ -691,6 +792,95 @@ union wl_argument {
 	int32_t h;           /**< `fd`     */
 };
 
+/** Maximum number of arguments of a message, as seen by a wl_message_view */
+#define WL_MESSAGE_VIEW_MAX_ARGS 20
+
+/**
+ * \struct wl_message_view
+ *
+ * \brief Validated wire data of a received message
+ *
+ * A wl_message_view gives access to the arguments of a message without
+ * unpacking them into a wl_argument array first. It refers to the
+ * message's wire words, which have been validated but are still in the
+ * connection buffer, so it is only valid during the call it is passed to.
+ *
+ * Arguments are read with the wl_message_view_get_*() functions, or the
+ * typed accessors wayland-scanner generates for each request.
+ *
+ * \sa wl_resource_set_view_implementation
+ */
+struct wl_message_view {
+	/** Wire words of the message, starting with its two header words */
+	const uint32_t *words;
+	/** Index in \c words of each argument */
+	uint16_t offsets[WL_MESSAGE_VIEW_MAX_ARGS];
+	/** Objects and file descriptors, by argument index */
+	union wl_argument args[WL_MESSAGE_VIEW_MAX_ARGS];
+};
+
+/** Get an `int` argument of a message view */
+static inline int32_t
+wl_message_view_get_int(const struct wl_message_view *view, int i)
+{
+	return (int32_t) view->words[view->offsets[i]];
+}
+
+/** Get a `uint` or `new_id` argument of a message view */
+static inline uint32_t
+wl_message_view_get_uint(const struct wl_message_view *view, int i)
+{
+	return view->words[view->offsets[i]];
+}
+
+/** Get a `fixed` argument of a message view */
+static inline wl_fixed_t
+wl_message_view_get_fixed(const struct wl_message_view *view, int i)
+{
+	return (wl_fixed_t) view->words[view->offsets[i]];
+}
+
+/** Get a `string` argument of a message view, NULL for a null string */
+static inline const char *
+wl_message_view_get_string(const struct wl_message_view *view, int i)
+{
+	const uint32_t *p = view->words + view->offsets[i];
+
+	return p[0] ? (const char *) (p + 1) : NULL;
+}
+
+/** Get an `array` argument of a message view
+ *
+ * The returned array refers to the message's data and must not be
+ * modified or released.
+ */
+static inline struct wl_array
+wl_message_view_get_array(const struct wl_message_view *view, int i)
+{
+	const uint32_t *p = view->words + view->offsets[i];
+	struct wl_array array;
+
+	array.size = p[0];
+	array.alloc = 0;
+	array.data = (void *) (p + 1);
+
+	return array;
+}
+
+/** Get an `object` argument of a message view, NULL for a null object */
+static inline struct wl_object *
+wl_message_view_get_object(const struct wl_message_view *view, int i)
+{
+	return view->args[i].o;
+}
+
+/** Get an `fd` argument of a message view, owned by the caller */
+static inline int32_t
+wl_message_view_get_fd(const struct wl_message_view *view, int i)
+{
+	return view->args[i].h;
+}
+
 /**
  * Dispatcher function type alias
  *
@@ -745,6 +935,59 @@ typedef int (*wl_dispatcher_func_t)(const void *user_data, void *target,
  */
 typedef void (*wl_log_func_t)(const char *fmt, va_list args) WL_PRINTF(1, 0);
 
+/**
+ * Memory allocator used by libwayland
+ *
+ * Each function gets the \c data pointer of the allocator as its first
+ * argument, followed by the arguments of the corresponding C library
+ * function. \c alloc and \c realloc return NULL on failure, and \c free
+ * must accept NULL.
+ *
+ * An allocator is installed with `wl_set_allocator_client` or
+ * `wl_set_allocator_server` and covers all memory libwayland allocates
+ * for itself, such as objects, closures and its internal arrays and maps.
+ * wl_array_add() and wl_array_release() called by the application keep
+ * using the C library's allocator, as the exported wl_array functions
+ * are shared between libwayland-client and libwayland-server.
+ *
+ * \sa wl_set_allocator_client
+ * \sa wl_set_allocator_server
+ */
+struct wl_allocator {
+	void *(*alloc)(void *data, size_t size);
+	void *(*realloc)(void *data, void *ptr, size_t size);
+	void (*free)(void *data, void *ptr);
+	void *data;
+};
+
+/**
+ * Counters of the adaptive socket send buffer of a connection
+ *
+ * Sizes are in the units getsockopt() reports for SO_SNDBUF, which on
+ * Linux include the kernel's bookkeeping overhead.
+ *
+ * \sa wl_display_set_client_socket_buffer_range
+ * \sa wl_display_set_socket_buffer_range
+ */
+struct wl_socket_buffer_stats {
+	/** Current size of the send buffer */
+	size_t size;
+	/** Size of the send buffer when adaptive sizing was enabled */
+	size_t initial_size;
+	/** Memory given back to the kernel, initial_size - size if
+	 * positive */
+	size_t bytes_saved;
+	/** Most data ever seen queued in the socket */
+	size_t peak_queued;
+	/** Number of times the buffer was grown */
+	uint64_t grows;
+	/** Number of times the buffer was shrunk */
+	uint64_t shrinks;
+	/** Flushes that would have failed with EAGAIN without growing the
+	 * buffer */
+	uint64_t eagain_avoided;
+};
+
 /**
  * Return value of an iterator function
  *
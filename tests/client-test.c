@@ -143,3 +143,531 @@ TEST(client_destroy_listener)
 	wl_display_destroy(display);
 }
 
+
+struct teardown_state {
+	struct client_destroy_listener listener;
+	int resources_destroyed;
+};
+
+static void
+teardown_resource_destroy(struct wl_resource *resource)
+{
+	struct teardown_state *state = wl_resource_get_user_data(resource);
+
+	assert(state->listener.done);
+	assert(!state->listener.late_done);
+	state->resources_destroyed++;
+	state->listener.resource_done = true;
+}
+
+TEST(client_incremental_teardown)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *resource;
+	struct teardown_state state = { 0 };
+	int s[2], i, iterations;
+	const int n_resources = 10;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	assert(wl_display_set_client_teardown_budget(display, 3) == 0);
+
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	for (i = 0; i < n_resources; i++) {
+		resource = wl_resource_create(client, &wl_callback_interface,
+					      1, 0);
+		assert(resource);
+		wl_resource_set_implementation(resource, NULL, &state,
+					       teardown_resource_destroy);
+	}
+
+	state.listener.listener.notify = client_destroy_notify;
+	state.listener.late_listener.notify = client_late_destroy_notify;
+	wl_client_add_destroy_listener(client, &state.listener.listener);
+	wl_client_add_destroy_late_listener(client,
+					    &state.listener.late_listener);
+
+	/* Hang up: the client is detached without destroying anything */
+	close(s[1]);
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(state.listener.done);
+	assert(wl_list_empty(wl_display_get_client_list(display)));
+	assert(wl_client_get_fd(client) == -1);
+
+	/* The display resource and the callbacks go three at a time */
+	iterations = 0;
+	while (!state.listener.late_done) {
+		assert(wl_event_loop_dispatch(loop, 0) == 0);
+		assert(state.resources_destroyed <= 3 * (iterations + 1));
+		iterations++;
+		assert(iterations < 10);
+	}
+	assert(iterations >= 3);
+	assert(state.resources_destroyed == n_resources);
+
+	wl_display_destroy(display);
+}
+
+TEST(client_incremental_teardown_finish)
+{
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_resource *resource;
+	struct teardown_state state = { 0 };
+	int s[2], i;
+	const int n_resources = 10;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	assert(wl_display_set_client_teardown_budget(display, 1) == 0);
+
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	for (i = 0; i < n_resources; i++) {
+		resource = wl_resource_create(client, &wl_callback_interface,
+					      1, 0);
+		assert(resource);
+		wl_resource_set_implementation(resource, NULL, &state,
+					       teardown_resource_destroy);
+	}
+
+	state.listener.listener.notify = client_destroy_notify;
+	state.listener.late_listener.notify = client_late_destroy_notify;
+	wl_client_add_destroy_listener(client, &state.listener.listener);
+	wl_client_add_destroy_late_listener(client,
+					    &state.listener.late_listener);
+
+	close(s[1]);
+	assert(wl_event_loop_dispatch(wl_display_get_event_loop(display),
+				      0) == 0);
+	assert(state.listener.done);
+	assert(!state.listener.late_done);
+
+	/* Pending teardowns are completed synchronously */
+	wl_display_destroy_clients(display);
+	assert(state.listener.late_done);
+	assert(state.resources_destroyed == n_resources);
+
+	wl_display_destroy(display);
+}
+
+struct counting_allocator {
+	int allocs;
+	int live;
+};
+
+static void *
+counting_alloc(void *data, size_t size)
+{
+	struct counting_allocator *counter = data;
+	void *p = malloc(size);
+
+	if (p) {
+		counter->allocs++;
+		counter->live++;
+	}
+
+	return p;
+}
+
+static void *
+counting_realloc(void *data, void *ptr, size_t size)
+{
+	struct counting_allocator *counter = data;
+	void *p = realloc(ptr, size);
+
+	if (p && !ptr) {
+		counter->allocs++;
+		counter->live++;
+	}
+
+	return p;
+}
+
+static void
+counting_free(void *data, void *ptr)
+{
+	struct counting_allocator *counter = data;
+
+	if (ptr)
+		counter->live--;
+	free(ptr);
+}
+
+TEST(client_custom_allocator)
+{
+	struct counting_allocator counter = { 0 };
+	const struct wl_allocator allocator = {
+		counting_alloc,
+		counting_realloc,
+		counting_free,
+		&counter
+	};
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_array array;
+	int s[2], allocs;
+
+	wl_set_allocator_server(&allocator);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	assert(wl_resource_create(client, &wl_callback_interface, 1, 0));
+	assert(counter.allocs > 0);
+	assert(counter.live > 0);
+
+	/* Arrays of the application keep using the C library */
+	allocs = counter.allocs;
+	wl_array_init(&array);
+	assert(wl_array_add(&array, 64));
+	wl_array_release(&array);
+	assert(counter.allocs == allocs);
+
+	wl_client_destroy(client);
+	wl_display_destroy(display);
+	close(s[1]);
+
+	wl_set_allocator_server(NULL);
+
+	/* Everything was freed through the allocator that allocated it */
+	assert(counter.live == 0);
+}
+
+TEST(client_oversized_message)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct client_destroy_listener a = { 0 };
+	uint32_t data[2048] = { 0 };
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	a.listener.notify = client_destroy_notify;
+	wl_client_add_destroy_listener(client, &a.listener);
+
+	/* A header announcing more than the connection buffer holds,
+	 * followed by enough data to fill it */
+	data[0] = 1;
+	data[1] = 0xfffc << 16;
+	assert(write(s[1], data, sizeof data) == sizeof data);
+
+	for (i = 0; i < 4 && !a.done; i++)
+		assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(a.done);
+
+	close(s[1]);
+	wl_display_destroy(display);
+}
+
+TEST(client_socket_buffer_idle_shrink)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *callback;
+	struct wl_socket_buffer_stats stats;
+	int s[2], optval = 4096, i;
+	char buffer[4096];
+	size_t grown, total = 0;
+	ssize_t len;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	assert(setsockopt(s[0], SOL_SOCKET, SO_SNDBUF,
+			  &optval, sizeof optval) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	assert(wl_display_set_client_socket_buffer_range(display, 8192,
+							 1 << 20) == 0);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	callback = wl_resource_create(client, &wl_callback_interface, 1, 0);
+	assert(callback);
+
+	/* A burst grows the buffer... */
+	for (i = 0; i < 4096; i++)
+		wl_callback_send_done(callback, i);
+	wl_display_flush_clients(display);
+	assert(wl_client_get_socket_buffer_stats(client, &stats) == 0);
+	assert(stats.grows > 0);
+	grown = stats.size;
+
+	while (total < 4096 * 12) {
+		len = read(s[1], buffer, sizeof buffer);
+		assert(len > 0);
+		total += len;
+	}
+
+	/* ...and it shrinks from the event loop while nothing is sent */
+	while (stats.shrinks == 0) {
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+		assert(wl_client_get_socket_buffer_stats(client, &stats) == 0);
+	}
+	assert(stats.size < grown);
+
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
+
+struct created_counter {
+	struct wl_listener listener;
+	int count;
+};
+
+static void
+count_resource_created(struct wl_listener *l, void *data)
+{
+	struct created_counter *counter =
+		wl_container_of(l, counter, listener);
+
+	counter->count++;
+}
+
+TEST(client_dispatch_until_deadline)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct created_counter counter = { .count = 0 };
+	struct timespec past = { 0, 0 };
+	uint32_t sync[3 * 10];
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	counter.listener.notify = count_resource_created;
+	wl_client_add_resource_created_listener(client, &counter.listener);
+
+	/* Ten wl_display.sync requests, each creating a wl_callback */
+	for (i = 0; i < 10; i++) {
+		sync[i * 3] = 1;
+		sync[i * 3 + 1] = (12 << 16) | 0;
+		sync[i * 3 + 2] = 2 + i;
+	}
+	assert(write(s[1], sync, sizeof sync) == sizeof sync);
+
+	/* Already out of time, so only one request is handled... */
+	assert(wl_event_loop_dispatch_until(loop, 0, &past) == 0);
+	assert(counter.count == 1);
+
+	/* ...and the rest, already read from the socket, later. */
+	assert(wl_event_loop_dispatch_until(loop, 0, &past) == 0);
+	assert(counter.count == 2);
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(counter.count == 10);
+
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
+
+struct quota_log {
+	int calls;
+	enum wl_client_quota quota;
+	uint64_t usage;
+};
+
+static void
+log_quota(struct wl_client *client, enum wl_client_quota quota,
+	  uint64_t usage, void *data)
+{
+	struct quota_log *log = data;
+
+	log->calls++;
+	log->quota = quota;
+	log->usage = usage;
+}
+
+TEST(client_quota_objects)
+{
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_resource *resources[4];
+	struct quota_log log = { 0 };
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	wl_display_set_client_quota_handler(display, log_quota, &log);
+	assert(wl_display_set_client_quota(display, WL_CLIENT_QUOTA_OBJECTS, 4,
+					   WL_CLIENT_QUOTA_ACTION_NOTIFY) == 0);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	/* The wl_display resource counts too */
+	assert(wl_client_get_quota_usage(client,
+					 WL_CLIENT_QUOTA_OBJECTS) == 1);
+	for (i = 0; i < 4; i++) {
+		resources[i] = wl_resource_create(client, &wl_callback_interface,
+						  1, 0);
+		assert(resources[i]);
+	}
+	assert(log.calls == 1);
+	assert(log.quota == WL_CLIENT_QUOTA_OBJECTS);
+	assert(log.usage == 5);
+
+	/* Only notified again after going back under the limit */
+	wl_resource_destroy(resources[3]);
+	resources[3] = wl_resource_create(client, &wl_callback_interface, 1, 0);
+	assert(resources[3]);
+	assert(log.calls == 2);
+
+	/* Refused when disconnecting */
+	assert(wl_client_set_quota(client, WL_CLIENT_QUOTA_OBJECTS, 5,
+				   WL_CLIENT_QUOTA_ACTION_DISCONNECT) == 0);
+	errno = 0;
+	assert(wl_resource_create(client, &wl_callback_interface, 1, 0) == NULL);
+	assert(errno == EDQUOT);
+	assert(log.calls == 3);
+	assert(wl_client_get_quota_usage(client,
+					 WL_CLIENT_QUOTA_OBJECTS) == 5);
+
+	/* Resources the compositor holds for the client */
+	assert(wl_client_set_quota(client, WL_CLIENT_QUOTA_FDS, 2,
+				   WL_CLIENT_QUOTA_ACTION_DISCONNECT) == 0);
+	assert(wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, 2) == 0);
+	assert(wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, 1) == -1);
+	assert(errno == EDQUOT);
+	assert(wl_client_quota_charge(client, WL_CLIENT_QUOTA_FDS, -2) == 0);
+	assert(wl_client_get_quota_usage(client, WL_CLIENT_QUOTA_FDS) == 0);
+	assert(wl_client_quota_charge(client, WL_CLIENT_QUOTA_REQUEST_RATE,
+				      1) == -1);
+	assert(errno == EINVAL);
+
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
+
+TEST(client_quota_request_rate)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct created_counter counter = { .count = 0 };
+	struct quota_log log = { 0 };
+	uint32_t sync[3 * 10];
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	wl_display_set_client_quota_handler(display, log_quota, &log);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	assert(wl_client_set_quota(client, WL_CLIENT_QUOTA_REQUEST_RATE, 4,
+				   WL_CLIENT_QUOTA_ACTION_THROTTLE) == 0);
+
+	counter.listener.notify = count_resource_created;
+	wl_client_add_resource_created_listener(client, &counter.listener);
+
+	for (i = 0; i < 10; i++) {
+		sync[i * 3] = 1;
+		sync[i * 3 + 1] = (12 << 16) | 0;
+		sync[i * 3 + 2] = 2 + i;
+	}
+	assert(write(s[1], sync, sizeof sync) == sizeof sync);
+
+	/* Four requests per second, the rest wait for the next windows */
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(counter.count == 4);
+	assert(log.calls == 1);
+	assert(log.quota == WL_CLIENT_QUOTA_REQUEST_RATE);
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(counter.count == 4);
+
+	while (counter.count < 8)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(counter.count == 8);
+	assert(log.calls == 2);
+
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
+
+static void
+count_region_adds(struct wl_client *client, struct wl_resource *resource,
+		  uint32_t opcode, union wl_argument **args, uint32_t count)
+{
+	int *adds = wl_resource_get_user_data(resource);
+
+	*adds += count;
+}
+
+TEST(client_quota_request_rate_batch)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *region;
+	uint32_t add[6 * 10];
+	int s[2], i, adds = 0;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	assert(wl_client_set_quota(client, WL_CLIENT_QUOTA_REQUEST_RATE, 4,
+				   WL_CLIENT_QUOTA_ACTION_THROTTLE) == 0);
+
+	region = wl_resource_create(client, &wl_region_interface, 1, 0);
+	assert(region);
+	wl_resource_set_implementation(region, NULL, &adds, NULL);
+	/* wl_region.add */
+	assert(wl_resource_set_batch_handler(region, 1 << 1,
+					     count_region_adds) == 0);
+
+	for (i = 0; i < 10; i++) {
+		add[i * 6] = wl_resource_get_id(region);
+		add[i * 6 + 1] = (24 << 16) | 1;
+		add[i * 6 + 2] = i;
+		add[i * 6 + 3] = 0;
+		add[i * 6 + 4] = 1;
+		add[i * 6 + 5] = 1;
+	}
+	assert(write(s[1], add, sizeof add) == sizeof add);
+
+	/* Every request of a batch counts */
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(adds == 4);
+	assert(wl_client_get_quota_usage(client,
+					 WL_CLIENT_QUOTA_REQUEST_RATE) == 5);
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(adds == 4);
+
+	while (adds < 8)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(adds == 8);
+
+	wl_client_destroy(client);
+	close(s[1]);
+	wl_display_destroy(display);
+}
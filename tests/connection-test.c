@@ -23,6 +23,8 @@
  * SOFTWARE.
  */
 
+#include "../config.h"
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -130,6 +132,116 @@ TEST(connection_queue)
 	close(s[1]);
 }
 
+TEST(connection_overflow)
+{
+	struct wl_connection *connection;
+	int s[2], optval = 4096, n, i, j;
+	uint32_t chunk[16], *data;
+	size_t max_overflow = 16384, total, received;
+	ssize_t len;
+
+	connection = setup(s);
+	assert(setsockopt(s[0], SOL_SOCKET, SO_SNDBUF,
+			  &optval, sizeof optval) == 0);
+	wl_connection_set_max_overflow(connection, max_overflow);
+
+	/* Write numbered chunks without reading until the socket and the
+	 * out buffer are full, and the overflow queue hits its limit. */
+	for (n = 0; ; n++) {
+		for (j = 0; j < 16; j++)
+			chunk[j] = n;
+		if (wl_connection_write(connection, chunk, sizeof chunk) < 0)
+			break;
+		assert(wl_connection_overflow_size(connection) <= max_overflow);
+	}
+	assert(errno == EAGAIN);
+	assert(wl_connection_overflow_size(connection) > 0);
+
+	/* Everything written before the failure must arrive in order. */
+	total = n * sizeof chunk;
+	data = malloc(total);
+	assert(data);
+	received = 0;
+	while (received < total) {
+		if (wl_connection_flush(connection) < 0)
+			assert(errno == EAGAIN);
+		len = recv(s[1], (char *) data + received, total - received,
+			   MSG_DONTWAIT);
+		assert(len > 0 || (len < 0 && errno == EAGAIN));
+		if (len > 0)
+			received += len;
+	}
+	assert(wl_connection_overflow_size(connection) == 0);
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < 16; j++)
+			assert(data[i * 16 + j] == (uint32_t) i);
+
+	free(data);
+	wl_connection_destroy(connection);
+	close(s[0]);
+	close(s[1]);
+}
+
+TEST(connection_sndbuf_adaptive)
+{
+	struct wl_connection *connection;
+	struct wl_socket_buffer_stats stats;
+	int s[2], optval = 4096, i;
+	uint32_t chunk[16] = { 0 };
+	char buffer[4096];
+	size_t grown, total = 0;
+	ssize_t len;
+
+	connection = setup(s);
+	assert(setsockopt(s[0], SOL_SOCKET, SO_SNDBUF,
+			  &optval, sizeof optval) == 0);
+	assert(wl_connection_get_sndbuf_stats(connection, &stats) == -1);
+	assert(errno == ENOTSUP);
+	assert(wl_connection_set_sndbuf_range(connection, 8192, 4096) == -1);
+	assert(errno == EINVAL);
+	assert(wl_connection_set_sndbuf_range(connection, 8192, 1 << 20) == 0);
+
+	/* A burst that does not fit the initial buffer grows it instead of
+	 * failing with EAGAIN */
+	for (i = 0; i < 1024; i++)
+		assert(wl_connection_write(connection, chunk,
+					   sizeof chunk) == 0);
+	assert(wl_connection_flush(connection) >= 0);
+	assert(wl_connection_get_sndbuf_stats(connection, &stats) == 0);
+	assert(stats.grows > 0);
+	assert(stats.eagain_avoided > 0);
+	assert(stats.size > stats.initial_size);
+	assert(stats.peak_queued > 0);
+	grown = stats.size;
+
+	while (total < 1024 * sizeof chunk) {
+		len = read(s[1], buffer, sizeof buffer);
+		assert(len > 0);
+		total += len;
+	}
+
+	/* Once nothing is written any more, the buffer shrinks again
+	 * within two periods of a second */
+	for (i = 0; i < 30; i++) {
+		if (wl_connection_sndbuf_idle(connection) < 0)
+			break;
+		test_usleep(100000);
+	}
+	assert(wl_connection_get_sndbuf_stats(connection, &stats) == 0);
+	assert(stats.shrinks > 0);
+	assert(stats.size < grown);
+	assert(stats.bytes_saved == (stats.size < stats.initial_size ?
+				     stats.initial_size - stats.size : 0));
+
+	assert(wl_connection_set_sndbuf_range(connection, 0, 0) == 0);
+	assert(wl_connection_get_sndbuf_stats(connection, &stats) == -1);
+
+	wl_connection_destroy(connection);
+	close(s[0]);
+	close(s[1]);
+}
+
 static void
 va_list_wrapper(const char *signature, union wl_argument *args, int count, ...)
 {
@@ -644,6 +756,40 @@ TEST(connection_marshal_too_big)
 	free(big_string);
 }
 
+TEST(connection_marshal_mirrored)
+{
+	struct marshal_data data;
+	char *big_string = malloc(5000);
+	int i;
+
+	assert(big_string);
+	memset(big_string, ' ', 4999);
+	big_string[4999] = '\0';
+
+	setenv("WAYLAND_MIRRORED_RING_BUFFERS", "1", 1);
+	setup_marshal_data(&data);
+	unsetenv("WAYLAND_MIRRORED_RING_BUFFERS");
+
+#ifdef HAVE_MEMFD_CREATE
+	if (sysconf(_SC_PAGESIZE) == 4096) {
+		assert(wl_connection_is_mirrored(data.read_connection));
+		assert(wl_connection_is_mirrored(data.write_connection));
+	}
+#endif
+
+	/* 28 byte messages do not divide the ring buffer size, so they
+	 * keep straddling its end as the buffers wrap around. */
+	data.value.s = "cookie robots";
+	for (i = 0; i < 1000; i++)
+		marshal_demarshal(&data, (void *) validate_demarshal_s,
+				  28, "s", data.value.s);
+
+	expected_fail_marshal_send(&data, E2BIG, "s", big_string);
+
+	release_marshal_data(&data);
+	free(big_string);
+}
+
 static void
 marshal_helper(const char *format, void *handler, ...)
 {
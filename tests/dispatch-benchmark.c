@@ -0,0 +1,342 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures the cost of dispatching messages to objects picked at random
+ * among a growing number of them, so that once the objects no longer
+ * fit in the CPU caches every message pays for the cache misses of
+ * looking up and dispatching to its wl_resource or wl_proxy.
+ *
+ * Requests are wl_region.add calls dispatched by the server, events
+ * are wl_shm.format events dispatched by the client.  Both ends run in
+ * this process over a socketpair.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "wayland-server.h"
+#include "wayland-server-protocol.h"
+#include "wayland-client.h"
+#include "wayland-client-protocol.h"
+#include "test-runner.h"
+
+#define MESSAGES (1 << 20)
+#define BATCH 128
+
+static const int object_counts[] = { 16, 1024, 16384, 131072 };
+
+struct bench {
+	struct wl_display *server;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_display *display;
+	struct wl_registry *registry;
+	uint32_t compositor_name;
+	uint32_t shm_name;
+
+	struct wl_resource **shm_resources;
+	int shm_count;
+};
+
+struct object_data {
+	uint64_t count;
+	char padding[56];
+};
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 8;
+}
+
+static void
+pump(struct bench *b)
+{
+	assert(wl_display_flush(b->display) >= 0);
+	assert(wl_event_loop_dispatch(b->loop, 0) >= 0);
+	wl_display_flush_clients(b->server);
+
+	assert(wl_display_prepare_read(b->display) == 0);
+	assert(wl_display_read_events(b->display) == 0);
+	assert(wl_display_dispatch_pending(b->display) >= 0);
+}
+
+/* Server side */
+
+static void
+region_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+region_add(struct wl_client *client, struct wl_resource *resource,
+	   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct object_data *data = wl_resource_get_user_data(resource);
+
+	data->count++;
+}
+
+static const struct wl_region_interface region_implementation = {
+	.destroy = region_destroy,
+	.add = region_add,
+};
+
+static void
+region_resource_destroy(struct wl_resource *resource)
+{
+	free(wl_resource_get_user_data(resource));
+}
+
+static void
+compositor_create_region(struct wl_client *client,
+			 struct wl_resource *resource, uint32_t id)
+{
+	struct wl_resource *region;
+	struct object_data *data;
+
+	data = calloc(1, sizeof *data);
+	assert(data);
+	region = wl_resource_create(client, &wl_region_interface, 1, id);
+	assert(region);
+	wl_resource_set_implementation(region, &region_implementation,
+				       data, region_resource_destroy);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	.create_region = compositor_create_region,
+};
+
+static void
+bind_compositor(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &wl_compositor_interface,
+				      version, id);
+	assert(resource);
+	wl_resource_set_implementation(resource, &compositor_implementation,
+				       NULL, NULL);
+}
+
+static void
+shm_resource_destroy(struct wl_resource *resource)
+{
+	struct bench *b = wl_resource_get_user_data(resource);
+
+	b->shm_count--;
+}
+
+static void
+bind_shm(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	struct bench *b = data;
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &wl_shm_interface, version, id);
+	assert(resource);
+	wl_resource_set_implementation(resource, NULL, b,
+				       shm_resource_destroy);
+	b->shm_resources[b->shm_count++] = resource;
+}
+
+/* Client side */
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t name, const char *interface, uint32_t version)
+{
+	struct bench *b = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0)
+		b->compositor_name = name;
+	else if (strcmp(interface, wl_shm_interface.name) == 0)
+		b->shm_name = name;
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+static void
+shm_handle_format(void *data, struct wl_shm *shm, uint32_t format)
+{
+	struct object_data *object_data = data;
+
+	object_data->count++;
+}
+
+static const struct wl_shm_listener shm_listener = {
+	shm_handle_format
+};
+
+static double
+bench_requests(struct bench *b, int count)
+{
+	struct wl_compositor *compositor;
+	struct wl_region **regions;
+	uint32_t state = 1;
+	double start, elapsed;
+	int i, j;
+
+	compositor = wl_registry_bind(b->registry, b->compositor_name,
+				      &wl_compositor_interface, 1);
+	regions = calloc(count, sizeof *regions);
+	assert(regions);
+	for (i = 0; i < count; i++) {
+		regions[i] = wl_compositor_create_region(compositor);
+		if (i % BATCH == 0)
+			pump(b);
+	}
+	pump(b);
+
+	start = test_now();
+	for (i = 0; i < MESSAGES; i += BATCH) {
+		for (j = 0; j < BATCH; j++)
+			wl_region_add(regions[next_random(&state) % count],
+				      0, 0, 1, 1);
+		pump(b);
+	}
+	elapsed = test_now() - start;
+
+	for (i = 0; i < count; i++) {
+		wl_region_destroy(regions[i]);
+		if (i % BATCH == 0)
+			pump(b);
+	}
+	wl_compositor_destroy(compositor);
+	pump(b);
+	free(regions);
+
+	return elapsed / MESSAGES;
+}
+
+static double
+bench_events(struct bench *b, int count)
+{
+	struct wl_shm **shms;
+	struct object_data *data;
+	uint32_t state = 1;
+	double start, elapsed;
+	int i, j;
+
+	b->shm_resources = calloc(count, sizeof *b->shm_resources);
+	shms = calloc(count, sizeof *shms);
+	data = calloc(count, sizeof *data);
+	assert(b->shm_resources && shms && data);
+
+	for (i = 0; i < count; i++) {
+		shms[i] = wl_registry_bind(b->registry, b->shm_name,
+					   &wl_shm_interface, 1);
+		wl_shm_add_listener(shms[i], &shm_listener, &data[i]);
+		if (i % BATCH == 0)
+			pump(b);
+	}
+	pump(b);
+	assert(b->shm_count == count);
+
+	start = test_now();
+	for (i = 0; i < MESSAGES; i += BATCH) {
+		for (j = 0; j < BATCH; j++)
+			wl_shm_send_format(b->shm_resources[next_random(&state) %
+							    count],
+					   WL_SHM_FORMAT_XRGB8888);
+		pump(b);
+	}
+	elapsed = test_now() - start;
+
+	for (i = 0; i < count; i++) {
+		wl_shm_destroy(shms[i]);
+		wl_resource_destroy(b->shm_resources[i]);
+		if (i % BATCH == 0)
+			pump(b);
+	}
+	pump(b);
+	free(b->shm_resources);
+	b->shm_resources = NULL;
+	free(shms);
+	free(data);
+
+	return elapsed / MESSAGES;
+}
+
+int main(void)
+{
+	struct bench b = { 0 };
+	unsigned int i;
+	int fds[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+
+	b.server = wl_display_create();
+	assert(b.server);
+	b.loop = wl_display_get_event_loop(b.server);
+	assert(wl_global_create(b.server, &wl_compositor_interface, 1,
+				NULL, bind_compositor));
+	assert(wl_global_create(b.server, &wl_shm_interface, 1,
+				&b, bind_shm));
+	b.client = wl_client_create(b.server, fds[1]);
+	assert(b.client);
+
+	b.display = wl_display_connect_to_fd(fds[0]);
+	assert(b.display);
+	b.registry = wl_display_get_registry(b.display);
+	wl_registry_add_listener(b.registry, &registry_listener, &b);
+	pump(&b);
+	assert(b.compositor_name && b.shm_name);
+
+	printf("%-10s %14s %14s\n", "objects", "request (ns)", "event (ns)");
+	for (i = 0; i < sizeof object_counts / sizeof object_counts[0]; i++) {
+		double request = bench_requests(&b, object_counts[i]);
+		double event = bench_events(&b, object_counts[i]);
+
+		printf("%-10d %14.1f %14.1f\n",
+		       object_counts[i], request, event);
+	}
+
+	wl_registry_destroy(b.registry);
+	wl_display_disconnect(b.display);
+	wl_client_destroy(b.client);
+	wl_display_destroy(b.server);
+
+	return 0;
+}
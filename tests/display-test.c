@@ -659,6 +659,53 @@ TEST(threading_read_eagain_tst)
 	display_destroy(d);
 }
 
+static void
+threading_stats(void)
+{
+	DISABLE_LEAK_CHECKS;
+
+	struct client *c = client_connect();
+	struct wl_display_stats stats;
+	pthread_t th;
+
+	wl_display_set_stats_enabled(c->wl_display, true);
+
+	register_reading(c->wl_display);
+	th = create_thread(c, thread_prepare_and_read);
+
+	/* The thread is blocked in wl_display_read_events() until we
+	 * read, which must show up as one read wait. */
+	assert(wl_display_read_events(c->wl_display) == 0);
+
+	test_set_timeout(3);
+	pthread_join(th, NULL);
+
+	wl_display_get_stats(c->wl_display, &stats);
+	assert(stats.lock_acquisitions > 0);
+	assert(stats.lock_contended <= stats.lock_acquisitions);
+	assert(stats.read_waits == 1);
+	assert(stats.read_wait_ns > 0);
+
+	wl_display_set_stats_enabled(c->wl_display, false);
+	wl_display_reset_stats(c->wl_display);
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+	wl_display_get_stats(c->wl_display, &stats);
+	assert(stats.lock_acquisitions == 0);
+	assert(stats.read_waits == 0);
+
+	client_disconnect(c);
+}
+
+TEST(threading_stats_tst)
+{
+	struct display *d = display_create();
+
+	client_create_noarg(d, threading_stats);
+	display_run(d);
+
+	display_destroy(d);
+}
+
 static void *
 thread_prepare_and_read2(void *data)
 {
@@ -1502,7 +1549,8 @@ send_overflow_client(void *data)
 
 	/* On Linux, the actual socket data + metadata space is twice `optval`;
 	 * since each noop request requires 8 bytes, the buffer should overflow
-	 * within <=4096 iterations. */
+	 * within <=4096 iterations, and the overflow queue, which holds 16
+	 * bytes per noop request, after another ~65536. */
 	for (i = 0; i < 1000000; i++) {
 		noop_request(c);
 		err = wl_display_get_error(c->wl_display);
@@ -1558,6 +1606,77 @@ TEST(send_overflow_disconnection)
 	display_destroy(d);
 }
 
+static void
+send_overflow_backpressure_client(void *data)
+{
+	struct client *c = client_connect();
+	int *pipes = data;
+	char tmp = '\0';
+	int i, ret, sock, optval = 16384;
+	struct pollfd pfd;
+
+	sock = wl_display_get_fd(c->wl_display);
+	assert(setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &optval, sizeof(optval)) == 0);
+
+	assert(stop_display(c, 1) >= 0);
+
+	/* Send requests until they spill into the overflow queue, which
+	 * must not be an error. */
+	for (i = 0; i < 100000; i++) {
+		noop_request(c);
+		if (wl_display_get_overflow_size(c->wl_display) > 0)
+			break;
+	}
+	assert(wl_display_get_overflow_size(c->wl_display) > 0);
+	assert(wl_display_get_error(c->wl_display) == 0);
+
+	/* Let the compositor start reading */
+	assert(write(pipes[1], &tmp, sizeof(tmp)) == (ssize_t)sizeof(tmp));
+
+	pfd.fd = sock;
+	pfd.events = POLLOUT;
+	while ((ret = wl_display_flush(c->wl_display)) < 0) {
+		assert(errno == EAGAIN);
+		assert(poll(&pfd, 1, -1) == 1);
+	}
+	assert(wl_display_get_overflow_size(c->wl_display) == 0);
+
+	assert(stop_display(c, 1) >= 0);
+
+	client_disconnect(c);
+}
+
+TEST(send_overflow_backpressure)
+{
+	struct display *d;
+	char tmp;
+	int rpipe[2];
+	ssize_t ret;
+
+	assert(pipe(rpipe) != -1);
+
+	d = display_create();
+
+	(void) client_create(d, send_overflow_backpressure_client, &rpipe);
+	close(rpipe[1]);
+
+	display_run(d);
+	display_post_resume_events(d);
+	wl_display_flush_clients(d->wl_display);
+
+	/* Don't read any requests until the client has filled its socket */
+	do {
+		ret = read(rpipe[0], &tmp, sizeof(tmp));
+	} while (ret == -1 && errno == EINTR);
+	assert(ret == 1);
+	close(rpipe[0]);
+
+	display_run(d);
+	display_resume(d);
+
+	display_destroy(d);
+}
+
 static void
 registry_global_remove_before_handle_global(void *data,
 					    struct wl_registry *registry,
@@ -1710,3 +1829,275 @@ TEST(no_source_terminate)
 	display_run(d);
 	display_destroy(d);
 }
+
+#define LAZY_POOL_SIZE (64 * 1024 * 1024)
+
+static void
+lazy_shm_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t id, const char *intf, uint32_t ver)
+{
+	struct wl_shm **shm = data;
+
+	if (strcmp(intf, wl_shm_interface.name) == 0)
+		*shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
+}
+
+static const struct wl_registry_listener lazy_shm_registry_listener = {
+	lazy_shm_handle_global,
+	NULL
+};
+
+static struct wl_buffer *
+lazy_shm_create_buffer(struct wl_shm_pool *pool, int fd, int32_t offset,
+		       uint32_t marker)
+{
+	assert(pwrite(fd, &marker, sizeof marker, offset) == sizeof marker);
+
+	return wl_shm_pool_create_buffer(pool, offset, 16, 16, 64,
+					 WL_SHM_FORMAT_XRGB8888);
+}
+
+static void
+lazy_shm_client(void *data)
+{
+	struct client *c = client_connect();
+	struct wl_registry *registry;
+	struct wl_shm *shm = NULL;
+	struct wl_shm_pool *pool;
+	struct wl_buffer *b1, *b2, *b3;
+	char path[] = "/tmp/wayland-lazy-shm-XXXXXX";
+	int fd;
+
+	registry = wl_display_get_registry(c->wl_display);
+	wl_registry_add_listener(registry, &lazy_shm_registry_listener, &shm);
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+	assert(shm);
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	assert(ftruncate(fd, LAZY_POOL_SIZE) == 0);
+
+	pool = wl_shm_create_pool(shm, fd, LAZY_POOL_SIZE);
+	b1 = lazy_shm_create_buffer(pool, fd, 3 * 4096 + 8, 0x11111111);
+	b2 = lazy_shm_create_buffer(pool, fd, LAZY_POOL_SIZE / 2 + 100,
+				    0x22222222);
+	stop_display(c, 1);
+
+	/* Growing a lazy pool must not disturb existing buffers. */
+	wl_buffer_destroy(b1);
+	assert(ftruncate(fd, LAZY_POOL_SIZE * 2) == 0);
+	wl_shm_pool_resize(pool, LAZY_POOL_SIZE * 2);
+	b3 = lazy_shm_create_buffer(pool, fd, LAZY_POOL_SIZE + 4096,
+				    0x33333333);
+	stop_display(c, 1);
+
+	wl_buffer_destroy(b2);
+	wl_buffer_destroy(b3);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+	wl_shm_destroy(shm);
+	wl_registry_destroy(registry);
+
+	client_disconnect(c);
+}
+
+static enum wl_iterator_result
+lazy_shm_check_buffer(struct wl_resource *resource, void *data)
+{
+	struct wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
+	uint32_t *seen = data;
+
+	if (buffer) {
+		wl_shm_buffer_begin_access(buffer);
+		*seen |= *(uint32_t *) wl_shm_buffer_get_data(buffer);
+		wl_shm_buffer_end_access(buffer);
+	}
+
+	return WL_ITERATOR_CONTINUE;
+}
+
+TEST(lazy_shm_pool)
+{
+	struct display *d;
+	struct client_info *ci;
+	uint32_t seen;
+
+	d = display_create();
+	assert(wl_display_init_shm(d->wl_display) == 0);
+	wl_display_set_shm_lazy_mapping(d->wl_display, LAZY_POOL_SIZE);
+
+	ci = client_create_noarg(d, lazy_shm_client);
+	display_run(d);
+
+	seen = 0;
+	wl_client_for_each_resource(ci->wl_client, lazy_shm_check_buffer,
+				    &seen);
+	assert(seen == (0x11111111 | 0x22222222));
+
+	display_resume(d);
+
+	seen = 0;
+	wl_client_for_each_resource(ci->wl_client, lazy_shm_check_buffer,
+				    &seen);
+	assert(seen == (0x22222222 | 0x33333333));
+
+	display_resume(d);
+
+	display_destroy(d);
+}
+
+#define SHM_EXTRA_FORMATS 40
+#define SHM_EXTRA_FORMAT(i) ((uint32_t) (0x30303030 + (i)))
+/* More wl_shm.format events than fit in a connection's buffer */
+#define SHM_MANY_FORMATS 400
+#define SHM_REPLACED_FORMAT 0x52524752
+
+struct shm_formats {
+	uint32_t formats[SHM_MANY_FORMATS + 2];
+	int count;
+};
+
+static void
+shm_formats_handle_format(void *data, struct wl_shm *shm, uint32_t format)
+{
+	struct shm_formats *formats = data;
+
+	assert(formats->count < SHM_MANY_FORMATS + 2);
+	formats->formats[formats->count++] = format;
+}
+
+static const struct wl_shm_listener shm_formats_listener = {
+	shm_formats_handle_format
+};
+
+static void
+shm_formats_check(struct client *c, int extra, int replaced)
+{
+	struct shm_formats formats = { .count = 0 };
+	struct wl_registry *registry;
+	struct wl_shm *shm = NULL;
+	int i;
+
+	registry = wl_display_get_registry(c->wl_display);
+	wl_registry_add_listener(registry, &lazy_shm_registry_listener, &shm);
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+	assert(shm);
+	wl_shm_add_listener(shm, &shm_formats_listener, &formats);
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+
+	assert(formats.count == 2 + extra);
+	assert(formats.formats[0] == WL_SHM_FORMAT_ARGB8888);
+	assert(formats.formats[1] == WL_SHM_FORMAT_XRGB8888);
+	for (i = 0; i < extra; i++)
+		assert(formats.formats[2 + i] == (i == replaced ?
+						  SHM_REPLACED_FORMAT :
+						  SHM_EXTRA_FORMAT(i)));
+
+	wl_shm_destroy(shm);
+	wl_registry_destroy(registry);
+}
+
+static void
+shm_formats_client(void *data)
+{
+	struct client *c = client_connect();
+	struct wl_registry *registry;
+	struct wl_shm *shm = NULL;
+	struct wl_shm_pool *pool;
+	struct wl_buffer *buffer;
+	char path[] = "/tmp/wayland-shm-formats-XXXXXX";
+	int fd;
+
+	shm_formats_check(c, SHM_EXTRA_FORMATS, -1);
+	stop_display(c, 1);
+
+	/* A format added later is announced to new wl_shm objects and
+	 * accepted for buffers. */
+	shm_formats_check(c, SHM_EXTRA_FORMATS + 1, -1);
+
+	registry = wl_display_get_registry(c->wl_display);
+	wl_registry_add_listener(registry, &lazy_shm_registry_listener, &shm);
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	assert(ftruncate(fd, 4096) == 0);
+	pool = wl_shm_create_pool(shm, fd, 4096);
+	buffer = wl_shm_pool_create_buffer(pool, 0, 16, 16, 64,
+					   SHM_EXTRA_FORMAT(SHM_EXTRA_FORMATS));
+	assert(wl_display_roundtrip(c->wl_display) >= 0);
+	wl_buffer_destroy(buffer);
+
+	wl_shm_pool_create_buffer(pool, 0, 16, 16, 64, 0x41414141);
+	assert(wl_display_roundtrip(c->wl_display) == -1);
+	assert(wl_display_get_error(c->wl_display) == EPROTO);
+	assert(wl_display_get_protocol_error(c->wl_display, NULL, NULL) ==
+	       WL_SHM_ERROR_INVALID_FORMAT);
+
+	close(fd);
+	client_disconnect_nocheck(c);
+}
+
+TEST(shm_formats)
+{
+	struct display *d;
+	int i;
+
+	d = display_create();
+	assert(wl_display_init_shm(d->wl_display) == 0);
+	for (i = 0; i < SHM_EXTRA_FORMATS; i++)
+		assert(wl_display_add_shm_format(d->wl_display,
+						 SHM_EXTRA_FORMAT(i)));
+
+	client_create_noarg(d, shm_formats_client);
+	display_run(d);
+
+	assert(wl_display_add_shm_format(d->wl_display,
+					 SHM_EXTRA_FORMAT(SHM_EXTRA_FORMATS)));
+	display_resume(d);
+
+	display_destroy(d);
+}
+
+static void
+shm_formats_many_client(void *data)
+{
+	struct client *c = client_connect();
+
+	shm_formats_check(c, SHM_MANY_FORMATS, -1);
+	stop_display(c, 1);
+
+	/* A format changed through the pointer returned by
+	 * wl_display_add_shm_format() is announced as changed. */
+	shm_formats_check(c, SHM_MANY_FORMATS, 7);
+
+	client_disconnect(c);
+}
+
+TEST(shm_formats_many)
+{
+	struct display *d;
+	uint32_t *replaced = NULL, *p;
+	int i;
+
+	d = display_create();
+	assert(wl_display_init_shm(d->wl_display) == 0);
+	for (i = 0; i < SHM_MANY_FORMATS; i++) {
+		p = wl_display_add_shm_format(d->wl_display,
+					      SHM_EXTRA_FORMAT(i));
+		assert(p);
+		if (i == 7)
+			replaced = p;
+	}
+
+	client_create_noarg(d, shm_formats_many_client);
+	display_run(d);
+
+	/* Nothing has been added since, so the pointer is still valid. */
+	*replaced = SHM_REPLACED_FORMAT;
+	display_resume(d);
+
+	display_destroy(d);
+}
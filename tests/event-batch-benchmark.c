@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures posting runs of events to one client, such as the frame
+ * callbacks of many surfaces, one wl_resource_post_event() at a time
+ * and as a single wl_client_post_events() batch.  The client end of the
+ * socketpair is drained between runs so that the socket never fills up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "wayland-server.h"
+#include "wayland-server-protocol.h"
+#include "test-runner.h"
+
+#define EVENTS (1 << 20)
+
+static const int run_lengths[] = { 1, 4, 16, 64 };
+
+static void
+drain(struct wl_display *display, int fd)
+{
+	char buffer[65536];
+
+	wl_display_flush_clients(display);
+	while (recv(fd, buffer, sizeof buffer, MSG_DONTWAIT) > 0)
+		;
+}
+
+int main(void)
+{
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_resource *callbacks[64];
+	struct wl_resource_event events[64];
+	union wl_argument args[64];
+	double start, single, batch;
+	unsigned int r;
+	int fds[2], i, j, n;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	display = wl_display_create();
+	assert(display);
+	client = wl_client_create(display, fds[0]);
+	assert(client);
+	for (i = 0; i < 64; i++) {
+		callbacks[i] = wl_resource_create(client, &wl_callback_interface,
+						  1, 0);
+		assert(callbacks[i]);
+		args[i].u = i;
+		events[i].resource = callbacks[i];
+		events[i].opcode = WL_CALLBACK_DONE;
+		events[i].args = &args[i];
+	}
+
+	printf("%-8s %14s %14s\n", "run", "single (ns)", "batch (ns)");
+	for (r = 0; r < sizeof run_lengths / sizeof run_lengths[0]; r++) {
+		n = run_lengths[r];
+
+		start = test_now();
+		for (i = 0; i < EVENTS; i += n) {
+			for (j = 0; j < n; j++)
+				wl_callback_send_done(callbacks[j], j);
+			if (i % 1024 == 0)
+				drain(display, fds[1]);
+		}
+		single = (test_now() - start) / EVENTS;
+		drain(display, fds[1]);
+
+		start = test_now();
+		for (i = 0; i < EVENTS; i += n) {
+			wl_client_post_events(client, events, n);
+			if (i % 1024 == 0)
+				drain(display, fds[1]);
+		}
+		batch = (test_now() - start) / EVENTS;
+		drain(display, fds[1]);
+
+		printf("%-8d %14.1f %14.1f\n", n, single, batch);
+	}
+
+	wl_client_destroy(client);
+	wl_display_destroy(display);
+	close(fds[1]);
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Keeps a number of fd sources ready all the time and measures how
+ * wl_event_loop_dispatch() serves them: how many get dispatched per call,
+ * how many calls the least lucky source waits between two dispatches,
+ * and the cost per dispatched source.  Each call also runs the idle and
+ * post-dispatch work, so fewer calls per round means less of that.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "wayland-server.h"
+#include "test-runner.h"
+
+#define SOURCES 256
+#define CALLS 2000
+
+struct source {
+	struct wl_event_source *source;
+	int p[2];
+	int last;
+	int max_wait;
+};
+
+static int call;
+static long dispatched;
+
+static const int max_events[] = { 8, 32, 0 };
+
+static int
+fd_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct source *source = data;
+
+	if (call - source->last > source->max_wait)
+		source->max_wait = call - source->last;
+	source->last = call;
+	dispatched++;
+
+	return 0;
+}
+
+static void
+run(int max)
+{
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct source sources[SOURCES];
+	double start, elapsed;
+	int i, max_wait = 0;
+
+	assert(loop);
+	assert(wl_event_loop_set_max_events(loop, max) == 0);
+
+	for (i = 0; i < SOURCES; i++) {
+		assert(pipe(sources[i].p) == 0);
+		assert(write(sources[i].p[1], "x", 1) == 1);
+		sources[i].last = 0;
+		sources[i].max_wait = 0;
+		sources[i].source =
+			wl_event_loop_add_fd(loop, sources[i].p[0],
+					     WL_EVENT_READABLE,
+					     fd_dispatch, &sources[i]);
+		assert(sources[i].source);
+	}
+
+	dispatched = 0;
+	start = test_now();
+	for (call = 1; call <= CALLS; call++)
+		assert(wl_event_loop_dispatch(loop, 0) == 0);
+	elapsed = test_now() - start;
+
+	for (i = 0; i < SOURCES; i++) {
+		if (sources[i].max_wait > max_wait)
+			max_wait = sources[i].max_wait;
+		wl_event_source_remove(sources[i].source);
+		close(sources[i].p[0]);
+		close(sources[i].p[1]);
+	}
+	wl_event_loop_destroy(loop);
+
+	if (max)
+		printf("%-10d", max);
+	else
+		printf("%-10s", "auto");
+	printf(" %16.1f %16d %14.1f\n", (double) dispatched / CALLS,
+	       max_wait, elapsed / dispatched);
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	printf("%d sources always ready\n", SOURCES);
+	printf("%-10s %16s %16s %14s\n", "batch", "sources/call",
+	       "max wait (calls)", "source (ns)");
+	for (i = 0; i < sizeof max_events / sizeof max_events[0]; i++)
+		run(max_events[i]);
+
+	return 0;
+}
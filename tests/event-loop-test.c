@@ -553,3 +553,239 @@ TEST(event_loop_destroy)
 	assert(a.done);
 }
 
+
+struct priority_context {
+	int order[8];
+	int count;
+};
+
+struct priority_source {
+	struct priority_context *context;
+	struct wl_event_source *source;
+	enum wl_event_priority priority;
+	int p[2];
+};
+
+static int
+priority_fd_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct priority_source *ps = data;
+	char c;
+
+	assert(read(fd, &c, 1) == 1);
+	assert(ps->context->count < 8);
+	ps->context->order[ps->context->count++] = ps->priority;
+
+	return 0;
+}
+
+TEST(event_loop_priority)
+{
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct priority_context context = { 0 };
+	struct priority_source sources[3];
+	static const enum wl_event_priority priorities[3] = {
+		WL_EVENT_PRIORITY_BACKGROUND,
+		WL_EVENT_PRIORITY_CLIENT,
+		WL_EVENT_PRIORITY_INPUT,
+	};
+	struct timespec deadline = { 0, 0 };
+	int i;
+
+	assert(loop);
+
+	for (i = 0; i < 3; i++) {
+		sources[i].context = &context;
+		sources[i].priority = priorities[i];
+		assert(pipe(sources[i].p) == 0);
+		sources[i].source =
+			wl_event_loop_add_fd(loop, sources[i].p[0],
+					     WL_EVENT_READABLE,
+					     priority_fd_dispatch,
+					     &sources[i]);
+		assert(sources[i].source);
+		if (priorities[i] != WL_EVENT_PRIORITY_CLIENT)
+			assert(wl_event_source_set_priority(sources[i].source,
+							    priorities[i]) == 0);
+		assert(write(sources[i].p[1], "x", 1) == 1);
+	}
+
+	assert(wl_event_source_set_priority(sources[0].source, 4) == -1);
+
+	/* Dispatched in class order, whatever order epoll reports. */
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(context.count == 3);
+	assert(context.order[0] == WL_EVENT_PRIORITY_INPUT);
+	assert(context.order[1] == WL_EVENT_PRIORITY_CLIENT);
+	assert(context.order[2] == WL_EVENT_PRIORITY_BACKGROUND);
+
+	/* Past the deadline, classes below input wait for input. */
+	wl_event_loop_set_priority_deadline(loop, WL_EVENT_PRIORITY_INPUT,
+					    &deadline);
+	for (i = 0; i < 3; i++)
+		assert(write(sources[i].p[1], "x", 1) == 1);
+
+	context.count = 0;
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(context.count == 1);
+	assert(context.order[0] == WL_EVENT_PRIORITY_INPUT);
+
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(context.count == 2);
+	assert(context.order[1] == WL_EVENT_PRIORITY_CLIENT);
+
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(context.count == 3);
+	assert(context.order[2] == WL_EVENT_PRIORITY_BACKGROUND);
+
+	/* Without a deadline nothing is deferred. */
+	wl_event_loop_set_priority_deadline(loop, WL_EVENT_PRIORITY_INPUT,
+					    NULL);
+	for (i = 0; i < 3; i++)
+		assert(write(sources[i].p[1], "x", 1) == 1);
+
+	context.count = 0;
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+	assert(context.count == 3);
+
+	for (i = 0; i < 3; i++) {
+		wl_event_source_remove(sources[i].source);
+		close(sources[i].p[0]);
+		close(sources[i].p[1]);
+	}
+	wl_event_loop_destroy(loop);
+}
+
+struct batch_source {
+	struct wl_event_source *source;
+	int *count;
+	int *first;
+	int index;
+	int p[2];
+};
+
+static int
+batch_fd_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct batch_source *source = data;
+
+	/* The pipe is left readable, so the source stays ready. */
+	if (*source->first < 0)
+		*source->first = source->index;
+	(*source->count)++;
+
+	return 0;
+}
+
+static int
+batch_dispatch(struct wl_event_loop *loop, int *count, int *first)
+{
+	*count = 0;
+	*first = -1;
+	assert(wl_event_loop_dispatch(loop, 0) == 0);
+
+	return *count;
+}
+
+TEST(event_loop_max_events)
+{
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct batch_source sources[48];
+	int i, count, first, previous;
+
+	assert(loop);
+
+	for (i = 0; i < 48; i++) {
+		sources[i].count = &count;
+		sources[i].first = &first;
+		sources[i].index = i;
+		assert(pipe(sources[i].p) == 0);
+		sources[i].source =
+			wl_event_loop_add_fd(loop, sources[i].p[0],
+					     WL_EVENT_READABLE,
+					     batch_fd_dispatch, &sources[i]);
+		assert(sources[i].source);
+		assert(write(sources[i].p[1], "x", 1) == 1);
+	}
+
+	assert(wl_event_loop_set_max_events(loop, -1) == -1);
+
+	assert(wl_event_loop_set_max_events(loop, 8) == 0);
+	assert(batch_dispatch(loop, &count, &first) == 8);
+	assert(wl_event_loop_set_max_events(loop, 40) == 0);
+	assert(batch_dispatch(loop, &count, &first) == 40);
+	assert(batch_dispatch(loop, &count, &first) == 40);
+
+	/* The automatic size starts at 32 and grows once it fills up. */
+	assert(wl_event_loop_set_max_events(loop, 0) == 0);
+	assert(batch_dispatch(loop, &count, &first) == 32);
+	assert(batch_dispatch(loop, &count, &first) == 48);
+
+	/* Every source is reported each time, but dispatching starts
+	 * somewhere else. */
+	previous = first;
+	assert(batch_dispatch(loop, &count, &first) == 48);
+	assert(first != previous);
+
+	for (i = 0; i < 48; i++) {
+		wl_event_source_remove(sources[i].source);
+		close(sources[i].p[0]);
+		close(sources[i].p[1]);
+	}
+	wl_event_loop_destroy(loop);
+}
+
+TEST(event_loop_dispatch_until)
+{
+	struct wl_event_loop *loop = wl_event_loop_create();
+	struct batch_source sources[4];
+	struct timespec past = { 0, 0 }, deadline, before, after;
+	int i, count, first;
+
+	assert(loop);
+
+	for (i = 0; i < 4; i++) {
+		sources[i].count = &count;
+		sources[i].first = &first;
+		sources[i].index = i;
+		assert(pipe(sources[i].p) == 0);
+		sources[i].source =
+			wl_event_loop_add_fd(loop, sources[i].p[0],
+					     WL_EVENT_READABLE,
+					     batch_fd_dispatch, &sources[i]);
+		assert(sources[i].source);
+	}
+	assert(wl_event_source_set_priority(sources[3].source,
+					    WL_EVENT_PRIORITY_INPUT) == 0);
+
+	/* Nothing ready: waits until the deadline, not the timeout. */
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	deadline = before;
+	deadline.tv_nsec += 20 * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	assert(wl_event_loop_dispatch_until(loop, -1, &deadline) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &after);
+	assert(after.tv_sec - before.tv_sec < 5);
+
+	for (i = 0; i < 4; i++)
+		assert(write(sources[i].p[1], "x", 1) == 1);
+
+	/* Out of time, one client source still runs, input always does. */
+	count = 0;
+	first = -1;
+	assert(wl_event_loop_dispatch_until(loop, 0, &past) == 0);
+	assert(count == 2);
+
+	/* The others are still ready afterwards. */
+	assert(batch_dispatch(loop, &count, &first) == 4);
+
+	for (i = 0; i < 4; i++) {
+		wl_event_source_remove(sources[i].source);
+		close(sources[i].p[0]);
+		close(sources[i].p[1]);
+	}
+	wl_event_loop_destroy(loop);
+}
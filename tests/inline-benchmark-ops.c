@@ -0,0 +1,112 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include "wayland-server-core.h"
+#include "wayland-client-core.h"
+#include "inline-benchmark.h"
+
+static uintptr_t
+list_ops(struct wl_list *links, int count, int rounds)
+{
+	struct wl_list head;
+	uintptr_t sum = 0;
+	int i, j;
+
+	wl_list_init(&head);
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < count; j++)
+			wl_list_insert(&head, &links[j]);
+		sum += wl_list_empty(&head);
+		for (j = 0; j < count; j++)
+			wl_list_remove(&links[j]);
+		sum += wl_list_empty(&head);
+	}
+
+	return sum;
+}
+
+static uintptr_t
+array_ops(struct wl_array *array, int rounds)
+{
+	uintptr_t sum = 0;
+	uint32_t *p;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		if (array->size == array->alloc)
+			array->size = 0;
+		p = wl_array_add(array, sizeof *p);
+		*p = i;
+		sum += (uintptr_t) p;
+	}
+
+	return sum;
+}
+
+static uintptr_t
+resource_ops(struct wl_resource **resources, int count, int rounds)
+{
+	uintptr_t sum = 0;
+	int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < count; j++) {
+			sum += (uintptr_t) wl_resource_get_user_data(resources[j]);
+			sum += (uintptr_t) wl_resource_get_client(resources[j]);
+			sum += wl_resource_get_id(resources[j]);
+		}
+	}
+
+	return sum;
+}
+
+static uintptr_t
+proxy_ops(struct wl_proxy **proxies, int count, int rounds)
+{
+	uintptr_t sum = 0;
+	int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < count; j++) {
+			sum += (uintptr_t) wl_proxy_get_user_data(proxies[j]);
+			sum += wl_proxy_get_id(proxies[j]);
+		}
+	}
+
+	return sum;
+}
+
+#ifdef WL_INLINE_FAST_PATHS
+const struct inline_benchmark_ops inline_benchmark_ops_inline = {
+#else
+const struct inline_benchmark_ops inline_benchmark_ops_call = {
+#endif
+	list_ops,
+	array_ops,
+	resource_ops,
+	proxy_ops,
+};
@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares calling the exported wl_list, wl_array, wl_resource and
+ * wl_proxy helpers with the inline versions enabled by defining
+ * WL_INLINE_FAST_PATHS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/socket.h>
+
+#include "wayland-server.h"
+#include "wayland-client.h"
+#include "wayland-client-protocol.h"
+#include "inline-benchmark.h"
+#include "test-runner.h"
+
+#define OBJECTS 256
+#define ROUNDS 20000
+
+volatile uintptr_t global_sum;
+
+struct objects {
+	struct wl_list links[OBJECTS];
+	struct wl_array array;
+	struct wl_resource *resources[OBJECTS];
+	struct wl_proxy *proxies[OBJECTS];
+};
+
+static void
+run(const char *name, const struct inline_benchmark_ops *ops,
+    struct objects *o)
+{
+	double start, list, array, resource, proxy;
+	long ops_per_run = (long) OBJECTS * ROUNDS;
+
+	start = test_now();
+	global_sum = ops->list(o->links, OBJECTS, ROUNDS);
+	list = (test_now() - start) / (ops_per_run * 2);
+
+	start = test_now();
+	global_sum = ops->array(&o->array, OBJECTS * ROUNDS);
+	array = (test_now() - start) / ops_per_run;
+
+	start = test_now();
+	global_sum = ops->resource(o->resources, OBJECTS, ROUNDS);
+	resource = (test_now() - start) / (ops_per_run * 3);
+
+	start = test_now();
+	global_sum = ops->proxy(o->proxies, OBJECTS, ROUNDS);
+	proxy = (test_now() - start) / (ops_per_run * 2);
+
+	printf("%-8s %10.2f %10.2f %10.2f %10.2f\n",
+	       name, list, array, resource, proxy);
+}
+
+int main(void)
+{
+	struct objects *o;
+	struct wl_display *server, *display;
+	struct wl_client *client;
+	int fds[2];
+	int i;
+
+	o = calloc(1, sizeof *o);
+	assert(o);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	server = wl_display_create();
+	assert(server);
+	client = wl_client_create(server, fds[1]);
+	assert(client);
+	display = wl_display_connect_to_fd(fds[0]);
+	assert(display);
+
+	for (i = 0; i < OBJECTS; i++) {
+		o->resources[i] = wl_resource_create(client,
+						     &wl_callback_interface,
+						     1, 0);
+		assert(o->resources[i]);
+		wl_resource_set_user_data(o->resources[i], &o->links[i]);
+
+		o->proxies[i] = wl_proxy_create((struct wl_proxy *) display,
+						&wl_callback_interface);
+		assert(o->proxies[i]);
+		wl_proxy_set_user_data(o->proxies[i], &o->links[i]);
+	}
+
+	wl_array_init(&o->array);
+	assert(wl_array_add(&o->array, 4096));
+
+	printf("ns/op    %10s %10s %10s %10s\n",
+	       "wl_list", "wl_array", "resource", "proxy");
+	run("call", &inline_benchmark_ops_call, o);
+	run("inline", &inline_benchmark_ops_inline, o);
+
+	wl_array_release(&o->array);
+	for (i = 0; i < OBJECTS; i++)
+		wl_proxy_destroy(o->proxies[i]);
+	wl_display_disconnect(display);
+	wl_client_destroy(client);
+	wl_display_destroy(server);
+	free(o);
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+
+struct wl_list;
+struct wl_array;
+struct wl_resource;
+struct wl_proxy;
+
+/* The same workloads, built once calling the exported functions and
+ * once with WL_INLINE_FAST_PATHS defined. */
+struct inline_benchmark_ops {
+	uintptr_t (*list)(struct wl_list *links, int count, int rounds);
+	uintptr_t (*array)(struct wl_array *array, int rounds);
+	uintptr_t (*resource)(struct wl_resource **resources, int count,
+			      int rounds);
+	uintptr_t (*proxy)(struct wl_proxy **proxies, int count, int rounds);
+};
+
+extern const struct inline_benchmark_ops inline_benchmark_ops_call;
+extern const struct inline_benchmark_ops inline_benchmark_ops_inline;
@@ -0,0 +1,212 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Replays the object id churn of a client with many surfaces against a
+ * wl_map: the frame callbacks of all surfaces are done at once and
+ * replaced, buffers are reallocated now and then and whole surfaces come
+ * and go.  After each frame the messages a surface update sends are
+ * looked up, one lookup per object argument.
+ *
+ * The replay runs once allocating ids with wl_map_insert_new and once
+ * with wl_map_insert_near next to the factory of each object, as
+ * wl_proxy does.  Reports the time spent allocating and freeing ids,
+ * the time spent looking them up, and how many cache lines of the map
+ * the live objects of one surface are spread over.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "wayland-private.h"
+#include "test-runner.h"
+
+#define FRAMES 199
+#define LINE_ENTRIES (64 / sizeof(void *))
+
+enum {
+	OBJECT_SURFACE,
+	OBJECT_VIEWPORT,
+	OBJECT_BUFFER0,
+	OBJECT_BUFFER1,
+	OBJECT_CALLBACK,
+	OBJECT_COUNT
+};
+
+struct surface {
+	uint32_t ids[OBJECT_COUNT];
+};
+
+struct replay {
+	struct wl_map map;
+	bool near;
+	uint32_t compositor;
+	int churn_ops;
+};
+
+static const int surface_counts[] = { 64, 1024, 8192 };
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 8;
+}
+
+static void
+create(struct replay *r, struct surface *surface, int object)
+{
+	uint32_t factory;
+
+	if (object == OBJECT_SURFACE)
+		factory = r->compositor;
+	else
+		factory = surface->ids[OBJECT_SURFACE];
+
+	if (r->near)
+		surface->ids[object] =
+			wl_map_insert_near(&r->map, 0, surface, factory);
+	else
+		surface->ids[object] = wl_map_insert_new(&r->map, 0, surface);
+	assert(surface->ids[object] != 0);
+	r->churn_ops++;
+}
+
+static void
+destroy(struct replay *r, struct surface *surface, int object)
+{
+	wl_map_remove(&r->map, surface->ids[object]);
+	r->churn_ops++;
+}
+
+static double
+lines_per_surface(struct surface *surfaces, int count)
+{
+	uint32_t lines[OBJECT_COUNT];
+	int i, j, k, total = 0;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < OBJECT_COUNT; j++) {
+			lines[j] = surfaces[i].ids[j] / LINE_ENTRIES;
+			for (k = 0; k < j; k++)
+				if (lines[k] == lines[j])
+					break;
+			if (k == j)
+				total++;
+		}
+	}
+
+	return (double) total / count;
+}
+
+static void
+run(int count, bool near)
+{
+	struct replay r = { .near = near };
+	struct surface *surfaces;
+	uintptr_t sum = 0;
+	uint32_t state = 1, n;
+	double start, churn = 0, lookup = 0;
+	int frame, i, j, lookups = 0;
+
+	surfaces = calloc(count, sizeof *surfaces);
+	assert(surfaces);
+
+	wl_map_init(&r.map, WL_MAP_CLIENT_SIDE);
+	/* id 0 is NULL and id 1 the display, as in a real client */
+	wl_map_insert_new(&r.map, 0, NULL);
+	wl_map_insert_new(&r.map, 0, &r);
+	r.compositor = wl_map_insert_new(&r.map, 0, &r);
+
+	for (i = 0; i < count; i++)
+		for (j = 0; j < OBJECT_COUNT; j++)
+			create(&r, &surfaces[i], j);
+
+	for (frame = 0; frame < FRAMES; frame++) {
+		start = test_now();
+		for (i = 0; i < count; i++)
+			destroy(&r, &surfaces[i], OBJECT_CALLBACK);
+
+		for (i = 0; i < count; i++) {
+			n = next_random(&state);
+			if (n % 64 == 0) {
+				for (j = OBJECT_SURFACE; j <= OBJECT_BUFFER1; j++)
+					destroy(&r, &surfaces[i], j);
+				for (j = OBJECT_SURFACE; j <= OBJECT_BUFFER1; j++)
+					create(&r, &surfaces[i], j);
+			} else if (n % 16 == 0) {
+				destroy(&r, &surfaces[i], OBJECT_BUFFER0);
+				destroy(&r, &surfaces[i], OBJECT_BUFFER1);
+				create(&r, &surfaces[i], OBJECT_BUFFER0);
+				create(&r, &surfaces[i], OBJECT_BUFFER1);
+			}
+			create(&r, &surfaces[i], OBJECT_CALLBACK);
+		}
+		churn += test_now() - start;
+
+		/* attach, damage, frame, commit */
+		start = test_now();
+		for (i = 0; i < count; i++) {
+			uint32_t *ids = surfaces[i].ids;
+
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_SURFACE]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_BUFFER0 + frame % 2]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_SURFACE]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_SURFACE]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_CALLBACK]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_SURFACE]);
+			sum += (uintptr_t) wl_map_lookup(&r.map, ids[OBJECT_VIEWPORT]);
+			lookups += 7;
+		}
+		lookup += test_now() - start;
+	}
+
+	assert(sum != 0);
+	printf("%-10d %-8s %14.1f %14.1f %14.2f\n", count,
+	       near ? "near" : "new", churn / r.churn_ops, lookup / lookups,
+	       lines_per_surface(surfaces, count));
+
+	wl_map_release(&r.map);
+	free(surfaces);
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	printf("%-10s %-8s %14s %14s %14s\n", "surfaces", "insert",
+	       "churn (ns)", "lookup (ns)", "lines/surface");
+	for (i = 0; i < sizeof surface_counts / sizeof surface_counts[0]; i++) {
+		run(surface_counts[i], false);
+		run(surface_counts[i], true);
+	}
+
+	return 0;
+}
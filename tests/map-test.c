@@ -100,6 +100,62 @@ TEST(map_remove)
 	wl_map_release(&map);
 }
 
+TEST(map_remove_prefers_nearby_ids)
+{
+	struct wl_map map;
+	uint32_t ids[32], i, a;
+
+	wl_map_init(&map, WL_MAP_SERVER_SIDE);
+	for (i = 0; i < 32; i++) {
+		ids[i] = wl_map_insert_new(&map, 0, &a);
+		assert(ids[i] == WL_SERVER_ID_START + i);
+	}
+
+	wl_map_remove(&map, ids[3]);
+	wl_map_remove(&map, ids[20]);
+	wl_map_remove(&map, ids[5]);
+
+	/* The most recently freed id comes back first, then the one
+	 * sharing its cache line, and only then the distant one */
+	assert(wl_map_insert_new(&map, 0, &a) == ids[5]);
+	assert(wl_map_insert_new(&map, 0, &a) == ids[3]);
+	assert(wl_map_insert_new(&map, 0, &a) == ids[20]);
+	assert(wl_map_insert_new(&map, 0, &a) == WL_SERVER_ID_START + 32);
+
+	/* Unless there is room next to the given id */
+	wl_map_remove(&map, ids[17]);
+	wl_map_remove(&map, ids[30]);
+	assert(wl_map_insert_near(&map, 0, &a, ids[16]) == ids[17]);
+
+	wl_map_release(&map);
+}
+
+TEST(map_lookup_cache)
+{
+	struct wl_map map;
+	uint32_t i, j, a, b;
+
+	wl_map_init(&map, WL_MAP_SERVER_SIDE);
+	i = wl_map_insert_new(&map, 0, &a);
+	assert(wl_map_lookup(&map, i) == &a);
+	assert(wl_map_lookup(&map, i) == &a);
+
+	wl_map_remove(&map, i);
+	assert(wl_map_lookup(&map, i) == NULL);
+	j = wl_map_insert_new(&map, 1, &b);
+	assert(j == i);
+	assert(wl_map_lookup(&map, j) == &b);
+	assert(wl_map_lookup_flags(&map, j) == 1);
+
+	assert(wl_map_insert_at(&map, 0, 0, &a) == 0);
+	assert(wl_map_lookup(&map, 0) == &a);
+	assert(wl_map_insert_at(&map, 0, 0, &b) == 0);
+	assert(wl_map_lookup(&map, 0) == &b);
+	assert(wl_map_lookup(&map, UINT32_MAX) == NULL);
+
+	wl_map_release(&map);
+}
+
 TEST(map_flags)
 {
 	struct wl_map map;
@@ -471,6 +471,61 @@ client_test_queue_destroy_default_with_attached_proxies(void)
 	free(callback);
 }
 
+struct batch_state {
+	int calls;
+	uint32_t events;
+};
+
+static void
+registry_handle_batch(void *data, struct wl_proxy *proxy,
+		      const struct wl_proxy_event *events, uint32_t count)
+{
+	struct batch_state *state = data;
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		assert(events[i].opcode == WL_REGISTRY_GLOBAL);
+		assert(strcmp(events[i].message->name, "global") == 0);
+		assert(events[i].args[1].s != NULL);
+	}
+
+	state->calls++;
+	state->events += count;
+}
+
+/* Test that consecutive events for a proxy with a batch listener are
+ * delivered in a single call. */
+static void
+client_test_queue_batch_listener(void)
+{
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct batch_state state = { 0 };
+	int ret;
+
+	display = wl_display_connect(NULL);
+	assert(display);
+
+	registry = wl_display_get_registry(display);
+	assert(registry != NULL);
+	assert(wl_proxy_add_batch_listener((struct wl_proxy *) registry,
+					   registry_handle_batch,
+					   &state) == 0);
+	assert(wl_proxy_add_batch_listener((struct wl_proxy *) registry,
+					   registry_handle_batch,
+					   &state) == -1);
+
+	ret = wl_display_roundtrip(display);
+	assert(ret >= 0);
+
+	/* The test global and the four dummy globals */
+	assert(state.calls == 1);
+	assert(state.events == 5);
+
+	wl_registry_destroy(registry);
+	wl_display_disconnect(display);
+}
+
 static void
 dummy_bind(struct wl_client *client,
 	   void *data, uint32_t version, uint32_t id)
@@ -597,3 +652,29 @@ TEST(queue_destroy_default_with_attached_proxies)
 
 	display_destroy(d);
 }
+
+TEST(queue_batch_listener)
+{
+	struct display *d;
+	const struct wl_interface *dummy_interfaces[] = {
+		&wl_seat_interface,
+		&wl_pointer_interface,
+		&wl_keyboard_interface,
+		&wl_surface_interface
+	};
+	unsigned int i;
+
+	d = display_create();
+
+	for (i = 0; i < ARRAY_LENGTH(dummy_interfaces); i++)
+		wl_global_create(d->wl_display, dummy_interfaces[i],
+				 dummy_interfaces[i]->version,
+				 NULL, dummy_bind);
+
+	test_set_timeout(2);
+
+	client_create_noarg(d, client_test_queue_batch_listener);
+	display_run(d);
+
+	display_destroy(d);
+}
@@ -27,7 +27,12 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 
+#include "wayland-private.h"
 #include "wayland-server.h"
 #include "test-runner.h"
 
@@ -206,3 +211,567 @@ TEST(free_without_remove)
 	assert(a.link.next == a.link.prev && a.link.next == NULL);
 	assert(b.link.next == b.link.prev && b.link.next == NULL);
 }
+
+struct attachment_state {
+	struct wl_resource *resource;
+	int destroyed;
+	_Bool destructor_ran;
+};
+
+static void
+attachment_res_destroy_func(struct wl_resource *res)
+{
+	struct attachment_state *state = wl_resource_get_user_data(res);
+
+	/* Attachments are still available from the resource destructor */
+	assert(state->destroyed == 0);
+	state->destructor_ran = 1;
+}
+
+static void
+attachment_destroy(struct wl_resource *res, void *data)
+{
+	struct attachment_state *state = data;
+
+	assert(state->resource == res);
+	assert(state->destructor_ran);
+	state->destroyed++;
+}
+
+TEST(resource_attachments)
+{
+	struct wl_display *display;
+	struct wl_client *client;
+	struct wl_resource *res;
+	struct attachment_state state = { 0 }, other = { 0 };
+	int s[2];
+	int key, nodestroy_key;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+
+	key = wl_display_register_resource_attachment(display,
+						      attachment_destroy);
+	assert(key == 0);
+	nodestroy_key = wl_display_register_resource_attachment(display, NULL);
+	assert(nodestroy_key == 1);
+
+	res = wl_resource_create(client, &wl_seat_interface, 4, 0);
+	assert(res);
+	wl_resource_set_implementation(res, NULL, &state,
+				       attachment_res_destroy_func);
+	state.resource = res;
+
+	/* unset and unregistered keys */
+	assert(wl_resource_get_attachment(res, key) == NULL);
+	assert(wl_resource_get_attachment(res, nodestroy_key) == NULL);
+	assert(wl_resource_get_attachment(res, 7) == NULL);
+	assert(wl_resource_set_attachment(res, 7, &state) < 0);
+	assert(wl_resource_set_attachment(res, -1, &state) < 0);
+
+	/* setting a slot replaces the value without destroying it */
+	assert(wl_resource_set_attachment(res, nodestroy_key, &other) == 0);
+	assert(wl_resource_get_attachment(res, key) == NULL);
+	assert(wl_resource_set_attachment(res, key, &other) == 0);
+	assert(wl_resource_set_attachment(res, key, &state) == 0);
+	assert(wl_resource_get_attachment(res, key) == &state);
+	assert(wl_resource_get_attachment(res, nodestroy_key) == &other);
+
+	wl_resource_destroy(res);
+	assert(state.destroyed == 1);
+	assert(other.destroyed == 0);
+
+	/* client destruction releases attachments too */
+	res = wl_resource_create(client, &wl_seat_interface, 4, 0);
+	assert(res);
+	memset(&state, 0, sizeof state);
+	wl_resource_set_implementation(res, NULL, &state,
+				       attachment_res_destroy_func);
+	state.resource = res;
+	assert(wl_resource_set_attachment(res, key, &state) == 0);
+
+	wl_client_destroy(client);
+	assert(state.destroyed == 1);
+
+	wl_display_destroy(display);
+	close(s[1]);
+}
+
+struct view_state {
+	struct wl_resource *surface;
+	int titles;
+	int transients;
+	int logged;
+};
+
+static void
+view_set_title(struct wl_client *client, struct wl_resource *resource,
+	       const struct wl_message_view *view)
+{
+	struct view_state *state = wl_resource_get_user_data(resource);
+	char title[32];
+
+	snprintf(title, sizeof title, "title %d", state->titles);
+	assert(strcmp(wl_shell_surface_set_title_view_get_title(view),
+		      title) == 0);
+	state->titles++;
+}
+
+static void
+view_set_transient(struct wl_client *client, struct wl_resource *resource,
+		   const struct wl_message_view *view)
+{
+	struct view_state *state = wl_resource_get_user_data(resource);
+
+	assert(wl_shell_surface_set_transient_view_get_parent(view) ==
+	       state->surface);
+	assert(wl_shell_surface_set_transient_view_get_x(view) == 3);
+	assert(wl_shell_surface_set_transient_view_get_y(view) == -4);
+	assert(wl_shell_surface_set_transient_view_get_flags(view) ==
+	       WL_SHELL_SURFACE_TRANSIENT_INACTIVE);
+	state->transients++;
+}
+
+static const struct wl_shell_surface_view_interface shell_surface_view = {
+	.set_transient = view_set_transient,
+	.set_title = view_set_title,
+};
+
+static void
+view_logger(void *user_data, enum wl_protocol_logger_type type,
+	    const struct wl_protocol_logger_message *message)
+{
+	struct view_state *state = user_data;
+
+	state->logged++;
+}
+
+static void
+send_request(struct wl_connection *connection,
+	     const struct wl_interface *interface, struct wl_resource *target,
+	     const char *name, union wl_argument *args)
+{
+	struct wl_object object = {
+		.interface = interface,
+		.id = wl_resource_get_id(target),
+	};
+	struct wl_closure *closure;
+	int opcode;
+
+	for (opcode = 0; opcode < interface->method_count; opcode++)
+		if (strcmp(interface->methods[opcode].name, name) == 0)
+			break;
+	assert(opcode < interface->method_count);
+
+	closure = wl_closure_marshal(&object, opcode, args,
+				     &interface->methods[opcode]);
+	assert(closure);
+	assert(wl_closure_send(closure, connection) == 0);
+	wl_closure_destroy(closure);
+}
+
+TEST(resource_view_implementation)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *res;
+	struct wl_connection *connection;
+	struct wl_protocol_logger *logger;
+	struct view_state state = { 0 };
+	union wl_argument args[4];
+	char titles[200][32];
+	const int n_titles = 200;
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	connection = wl_connection_create(s[1]);
+	assert(connection);
+
+	state.surface = wl_resource_create(client, &wl_surface_interface, 1, 0);
+	assert(state.surface);
+	res = wl_resource_create(client, &wl_shell_surface_interface, 1, 0);
+	assert(res);
+	wl_resource_set_view_implementation(res, &shell_surface_view,
+					    &state, NULL);
+
+	/* Enough requests to wrap around the connection's in buffer */
+	for (i = 0; i < n_titles; i++) {
+		snprintf(titles[i], sizeof titles[i], "title %d", i);
+		args[0].s = titles[i];
+		send_request(connection, &wl_shell_surface_interface, res, "set_title", args);
+	}
+	args[0].o = (struct wl_object *) state.surface;
+	args[1].i = 3;
+	args[2].i = -4;
+	args[3].u = WL_SHELL_SURFACE_TRANSIENT_INACTIVE;
+	send_request(connection, &wl_shell_surface_interface, res, "set_transient", args);
+	assert(wl_connection_flush(connection) > 0);
+
+	while (state.transients == 0)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(state.titles == n_titles);
+
+	/* Logged requests are dispatched through a view as well */
+	logger = wl_display_add_protocol_logger(display, view_logger, &state);
+	assert(logger);
+	send_request(connection, &wl_shell_surface_interface, res, "set_transient", args);
+	assert(wl_connection_flush(connection) > 0);
+	while (state.transients == 1)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(state.logged == 1);
+	wl_protocol_logger_destroy(logger);
+
+	wl_connection_destroy(connection);
+	wl_client_destroy(client);
+	wl_display_destroy(display);
+	close(s[1]);
+}
+
+/* Request opcodes of wl_region */
+#define REGION_ADD 1
+
+struct batch_state {
+	int calls;
+	int adds;
+	int subtracts;
+	int32_t x_sum;
+};
+
+static void
+batch_region_add(struct wl_client *client, struct wl_resource *resource,
+		 uint32_t opcode, union wl_argument **args, uint32_t count)
+{
+	struct batch_state *state = wl_resource_get_user_data(resource);
+	uint32_t i;
+
+	assert(opcode == REGION_ADD);
+	state->calls++;
+	for (i = 0; i < count; i++) {
+		state->x_sum += args[i][0].i;
+		assert(args[i][2].i == 10 && args[i][3].i == 20);
+	}
+	state->adds += count;
+}
+
+static void
+batch_region_subtract(struct wl_client *client, struct wl_resource *resource,
+		      int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct batch_state *state = wl_resource_get_user_data(resource);
+
+	state->subtracts++;
+}
+
+static const struct wl_region_interface batch_region_implementation = {
+	.subtract = batch_region_subtract,
+};
+
+/* Request opcodes of wl_data_offer and wl_surface */
+#define DATA_OFFER_RECEIVE 1
+#define SURFACE_ATTACH 1
+
+struct batch_fds {
+	int fds[8];
+	int count;
+};
+
+static void
+batch_offer_receive(struct wl_client *client, struct wl_resource *resource,
+		    uint32_t opcode, union wl_argument **args, uint32_t count)
+{
+	struct batch_fds *state = wl_resource_get_user_data(resource);
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		state->fds[state->count++] = args[i][1].h;
+}
+
+static void
+send_region_requests(struct wl_connection *connection,
+		     struct wl_resource *region, const char *name, int count)
+{
+	union wl_argument args[4];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		args[0].i = i;
+		args[1].i = 0;
+		args[2].i = 10;
+		args[3].i = 20;
+		send_request(connection, &wl_region_interface, region,
+			     name, args);
+	}
+}
+
+TEST(resource_batch_handler)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *res;
+	struct wl_connection *connection;
+	struct batch_state state = { 0 };
+	struct batch_fds fds = { .count = 0 };
+	struct wl_resource *offer;
+	union wl_argument args[2];
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	connection = wl_connection_create(s[1]);
+	assert(connection);
+
+	res = wl_resource_create(client, &wl_region_interface, 1, 0);
+	assert(res);
+	wl_resource_set_implementation(res, &batch_region_implementation,
+				       &state, NULL);
+
+	/* Opcodes must exist */
+	errno = 0;
+	assert(wl_resource_set_batch_handler(res, 1 << 3,
+					     batch_region_add) == -1);
+	assert(errno == EINVAL);
+	assert(wl_resource_set_batch_handler(res, 1 << REGION_ADD,
+					     batch_region_add) == 0);
+
+	/* Two runs of adds split by a subtract */
+	send_region_requests(connection, res, "add", 20);
+	send_region_requests(connection, res, "subtract", 1);
+	send_region_requests(connection, res, "add", 5);
+	assert(wl_connection_flush(connection) > 0);
+
+	while (state.adds < 25)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(state.calls == 2);
+	assert(state.subtracts == 1);
+	assert(state.x_sum == 190 + 10);
+
+	/* Clearing the handler leaves the implementation in place */
+	assert(wl_resource_set_batch_handler(res, 0, NULL) == 0);
+	send_region_requests(connection, res, "subtract", 3);
+	assert(wl_connection_flush(connection) > 0);
+	while (state.subtracts < 4)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	assert(state.calls == 2);
+
+	/* File descriptors are handed over to the handler */
+	offer = wl_resource_create(client, &wl_data_offer_interface, 1, 0);
+	assert(offer);
+	wl_resource_set_implementation(offer, NULL, &fds, NULL);
+	assert(wl_resource_set_batch_handler(offer, 1 << DATA_OFFER_RECEIVE,
+					     batch_offer_receive) == 0);
+	for (i = 0; i < 3; i++) {
+		args[0].s = "text/plain";
+		args[1].h = s[1];
+		send_request(connection, &wl_data_offer_interface, offer,
+			     "receive", args);
+	}
+	assert(wl_connection_flush(connection) > 0);
+	while (fds.count < 3)
+		assert(wl_event_loop_dispatch(loop, -1) == 0);
+	for (i = 0; i < fds.count; i++) {
+		assert(fcntl(fds.fds[i], F_GETFD) >= 0);
+		close(fds.fds[i]);
+	}
+
+	wl_connection_destroy(connection);
+	wl_client_destroy(client);
+	wl_display_destroy(display);
+	close(s[1]);
+}
+
+static void
+batch_surface_attach(struct wl_client *client, struct wl_resource *resource,
+		     uint32_t opcode, union wl_argument **args, uint32_t count)
+{
+	struct wl_resource *callback = wl_resource_get_user_data(resource);
+
+	wl_callback_send_done(callback, count);
+}
+
+TEST(resource_batch_handler_error)
+{
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_client *client;
+	struct wl_resource *surface, *callback;
+	struct wl_connection *connection;
+	struct wl_object unknown = { .id = 999 };
+	union wl_argument args[3];
+	uint32_t events[16];
+	int s[2], i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, s) == 0);
+	display = wl_display_create();
+	assert(display);
+	loop = wl_display_get_event_loop(display);
+	client = wl_client_create(display, s[0]);
+	assert(client);
+	connection = wl_connection_create(s[1]);
+	assert(connection);
+
+	callback = wl_resource_create(client, &wl_callback_interface, 1, 0);
+	assert(callback);
+	surface = wl_resource_create(client, &wl_surface_interface, 1, 0);
+	assert(surface);
+	wl_resource_set_implementation(surface, NULL, callback, NULL);
+	assert(wl_resource_set_batch_handler(surface, 1 << SURFACE_ATTACH,
+					     batch_surface_attach) == 0);
+
+	/* Two valid attaches followed by one to an unknown buffer */
+	args[1].i = 0;
+	args[2].i = 0;
+	for (i = 0; i < 3; i++) {
+		args[0].o = i < 2 ? NULL : &unknown;
+		send_request(connection, &wl_surface_interface, surface,
+			     "attach", args);
+	}
+	assert(wl_connection_flush(connection) > 0);
+	assert(wl_event_loop_dispatch(loop, -1) == 0);
+
+	/* The valid requests are handled before the error is sent */
+	assert(read(s[1], events, sizeof events) > 5 * 4);
+	assert(events[0] == wl_resource_get_id(callback));
+	assert(events[1] == (12 << 16 | WL_CALLBACK_DONE));
+	assert(events[2] == 2);
+	assert(events[3] == 1);
+	assert((events[4] & 0xffff) == WL_DISPLAY_ERROR);
+	assert(events[5] == 1);
+	assert(events[6] == WL_DISPLAY_ERROR_INVALID_METHOD);
+
+	wl_connection_destroy(connection);
+	wl_display_destroy(display);
+	close(s[1]);
+}
+
+/* Reads everything queued on fd, returning its size and counting the
+ * fds received along with it */
+static size_t
+read_all(int fd, char *data, size_t size, int *fds)
+{
+	char cmsg_buf[CMSG_SPACE(28 * sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	size_t total = 0;
+	ssize_t len;
+	int *p;
+
+	*fds = 0;
+	for (;;) {
+		iov.iov_base = data + total;
+		iov.iov_len = size - total;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsg_buf;
+		msg.msg_controllen = sizeof cmsg_buf;
+		len = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+		if (len <= 0)
+			break;
+		total += len;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			for (p = (int *) CMSG_DATA(cmsg);
+			     (char *) p < (char *) cmsg + cmsg->cmsg_len; p++) {
+				close(*p);
+				(*fds)++;
+			}
+		}
+	}
+
+	return total;
+}
+
+TEST(post_events_batch)
+{
+	struct wl_display *display;
+	struct wl_client *clients[2];
+	struct wl_resource *callbacks[2][40], *keyboards[2];
+	struct wl_resource_event events[42];
+	union wl_argument args[42][3];
+	static char single[16384], batch[16384];
+	size_t single_size, batch_size;
+	int s[2][2], single_fds, batch_fds, i, c;
+
+	display = wl_display_create();
+	assert(display);
+	for (c = 0; c < 2; c++) {
+		assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0,
+				  s[c]) == 0);
+		clients[c] = wl_client_create(display, s[c][0]);
+		assert(clients[c]);
+		for (i = 0; i < 40; i++) {
+			callbacks[c][i] = wl_resource_create(clients[c],
+							     &wl_callback_interface,
+							     1, 0);
+			assert(callbacks[c][i]);
+		}
+		keyboards[c] = wl_resource_create(clients[c],
+						  &wl_keyboard_interface, 1, 0);
+		assert(keyboards[c]);
+	}
+
+	/* The same events, one at a time to the first client... */
+	for (i = 0; i < 40; i++)
+		wl_callback_send_done(callbacks[0][i], i);
+	wl_keyboard_send_keymap(keyboards[0], WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP,
+				s[0][1], 0);
+	wl_resource_post_error(keyboards[0], 0, "done");
+
+	/* ...and in a single batch to the second one */
+	for (i = 0; i < 40; i++) {
+		args[i][0].u = i;
+		events[i].resource = callbacks[1][i];
+		events[i].opcode = WL_CALLBACK_DONE;
+		events[i].args = args[i];
+	}
+	args[40][0].u = WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP;
+	args[40][1].h = s[1][1];
+	args[40][2].u = 0;
+	events[40].resource = keyboards[1];
+	events[40].opcode = WL_KEYBOARD_KEYMAP;
+	events[40].args = args[40];
+	args[41][0].o = (struct wl_object *) keyboards[1];
+	args[41][1].u = 0;
+	args[41][2].s = "done";
+	events[41].resource = wl_client_get_object(clients[1], 1);
+	events[41].opcode = WL_DISPLAY_ERROR;
+	events[41].args = args[41];
+	wl_client_post_events(clients[1], events, 42);
+
+	wl_display_flush_clients(display);
+	single_size = read_all(s[0][1], single, sizeof single, &single_fds);
+	batch_size = read_all(s[1][1], batch, sizeof batch, &batch_fds);
+	assert(single_size > 40 * 12);
+	assert(batch_size == single_size);
+	assert(memcmp(single, batch, single_size) == 0);
+	assert(single_fds == 1);
+	assert(batch_fds == 1);
+
+	/* Objects of another client are refused */
+	events[0].resource = callbacks[0][0];
+	wl_client_post_events(clients[1], events, 1);
+	wl_display_flush_clients(display);
+	assert(read_all(s[1][1], batch, sizeof batch, &batch_fds) == 0);
+
+	for (c = 0; c < 2; c++) {
+		wl_client_destroy(clients[c]);
+		close(s[c][1]);
+	}
+	wl_display_destroy(display);
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright © 2026 The Wayland contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures how long a short-lived client takes to get its first frame
+ * on screen, split into the phases a real client goes through:
+ *
+ *   connect   wl_display_connect()
+ *   registry  wl_display_get_registry() and the round trip delivering
+ *             the globals
+ *   bind      binding wl_compositor and wl_shm and the round trip
+ *             completing the binds
+ *   commit    creating a wl_shm pool, buffer and surface, attaching
+ *             and committing until the requests are flushed
+ *   frame     waiting for the frame callback of that commit
+ *
+ * The compositor is a minimal in-tree one running on its own thread.
+ * Usage: startup-benchmark [iterations]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wayland-server.h"
+#include "wayland-server-protocol.h"
+#include "wayland-client.h"
+#include "wayland-client-protocol.h"
+#include "test-runner.h"
+
+#define DEFAULT_ITERATIONS 500
+#define BUFFER_WIDTH 64
+#define BUFFER_HEIGHT 64
+#define BUFFER_STRIDE (BUFFER_WIDTH * 4)
+#define BUFFER_SIZE (BUFFER_STRIDE * BUFFER_HEIGHT)
+
+enum phase {
+	PHASE_CONNECT,
+	PHASE_REGISTRY,
+	PHASE_BIND,
+	PHASE_COMMIT,
+	PHASE_FRAME,
+	PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {
+	"connect",
+	"registry",
+	"bind",
+	"commit",
+	"frame",
+};
+
+struct phase_stats {
+	double min, max, sum;
+};
+
+/* Compositor side */
+
+struct surface {
+	struct wl_resource *resource;
+	struct wl_resource *pending_buffer;
+	struct wl_list frame_callbacks;
+};
+
+static void
+surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+surface_attach(struct wl_client *client, struct wl_resource *resource,
+	       struct wl_resource *buffer, int32_t x, int32_t y)
+{
+	struct surface *surface = wl_resource_get_user_data(resource);
+
+	surface->pending_buffer = buffer;
+}
+
+static void
+surface_damage(struct wl_client *client, struct wl_resource *resource,
+	       int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void
+callback_unlink(struct wl_resource *resource)
+{
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void
+surface_frame(struct wl_client *client, struct wl_resource *resource,
+	      uint32_t callback)
+{
+	struct surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *cb;
+
+	cb = wl_resource_create(client, &wl_callback_interface, 1, callback);
+	if (!cb) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(cb, NULL, NULL, callback_unlink);
+	wl_list_insert(surface->frame_callbacks.prev,
+		       wl_resource_get_link(cb));
+}
+
+static void
+surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+	struct surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *cb, *next;
+	struct wl_shm_buffer *buffer;
+
+	if (surface->pending_buffer) {
+		/* "Composite" by touching the contents once. */
+		buffer = wl_shm_buffer_get(surface->pending_buffer);
+		if (buffer) {
+			wl_shm_buffer_begin_access(buffer);
+			*(volatile uint32_t *) wl_shm_buffer_get_data(buffer);
+			wl_shm_buffer_end_access(buffer);
+		}
+		wl_buffer_send_release(surface->pending_buffer);
+		surface->pending_buffer = NULL;
+	}
+
+	wl_resource_for_each_safe(cb, next, &surface->frame_callbacks) {
+		wl_callback_send_done(cb, 0);
+		wl_resource_destroy(cb);
+	}
+}
+
+static const struct wl_surface_interface surface_implementation = {
+	.destroy = surface_destroy,
+	.attach = surface_attach,
+	.damage = surface_damage,
+	.frame = surface_frame,
+	.commit = surface_commit,
+};
+
+static void
+surface_resource_destroy(struct wl_resource *resource)
+{
+	struct surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *cb, *next;
+
+	wl_resource_for_each_safe(cb, next, &surface->frame_callbacks)
+		wl_resource_destroy(cb);
+	free(surface);
+}
+
+static void
+compositor_create_surface(struct wl_client *client,
+			  struct wl_resource *resource, uint32_t id)
+{
+	struct surface *surface;
+
+	surface = calloc(1, sizeof *surface);
+	if (!surface) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	surface->resource = wl_resource_create(client, &wl_surface_interface,
+					       wl_resource_get_version(resource),
+					       id);
+	if (!surface->resource) {
+		free(surface);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_list_init(&surface->frame_callbacks);
+	wl_resource_set_implementation(surface->resource,
+				       &surface_implementation, surface,
+				       surface_resource_destroy);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	.create_surface = compositor_create_surface,
+};
+
+static void
+bind_compositor(struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &wl_compositor_interface,
+				      version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource, &compositor_implementation,
+				       NULL, NULL);
+}
+
+static void *
+compositor_thread(void *data)
+{
+	struct wl_display *display = data;
+
+	wl_display_run(display);
+
+	return NULL;
+}
+
+/* Client side */
+
+struct client {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_shm *shm;
+	uint32_t compositor_name;
+	uint32_t shm_name;
+	bool frame_done;
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t name, const char *interface, uint32_t version)
+{
+	struct client *client = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0)
+		client->compositor_name = name;
+	else if (strcmp(interface, wl_shm_interface.name) == 0)
+		client->shm_name = name;
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+static void
+frame_handle_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct client *client = data;
+
+	client->frame_done = true;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+	frame_handle_done
+};
+
+static int
+create_anonymous_file(off_t size)
+{
+	char path[] = "/tmp/wayland-startup-benchmark-XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	assert(ftruncate(fd, size) == 0);
+
+	return fd;
+}
+
+static void
+run_client(const char *socket_name, double elapsed[PHASE_COUNT])
+{
+	struct client client = { 0 };
+	struct wl_shm_pool *pool;
+	struct wl_buffer *buffer;
+	struct wl_surface *surface;
+	struct wl_callback *frame;
+	double start, t;
+	int fd;
+
+	start = test_now();
+	client.display = wl_display_connect(socket_name);
+	assert(client.display);
+	t = test_now();
+	elapsed[PHASE_CONNECT] = (t - start) / 1e3;
+	start = t;
+
+	client.registry = wl_display_get_registry(client.display);
+	wl_registry_add_listener(client.registry, &registry_listener, &client);
+	assert(wl_display_roundtrip(client.display) >= 0);
+	assert(client.compositor_name && client.shm_name);
+	t = test_now();
+	elapsed[PHASE_REGISTRY] = (t - start) / 1e3;
+	start = t;
+
+	client.compositor = wl_registry_bind(client.registry,
+					     client.compositor_name,
+					     &wl_compositor_interface, 4);
+	client.shm = wl_registry_bind(client.registry, client.shm_name,
+				      &wl_shm_interface, 1);
+	assert(wl_display_roundtrip(client.display) >= 0);
+	t = test_now();
+	elapsed[PHASE_BIND] = (t - start) / 1e3;
+	start = t;
+
+	fd = create_anonymous_file(BUFFER_SIZE);
+	pool = wl_shm_create_pool(client.shm, fd, BUFFER_SIZE);
+	buffer = wl_shm_pool_create_buffer(pool, 0, BUFFER_WIDTH,
+					   BUFFER_HEIGHT, BUFFER_STRIDE,
+					   WL_SHM_FORMAT_XRGB8888);
+	surface = wl_compositor_create_surface(client.compositor);
+	wl_surface_attach(surface, buffer, 0, 0);
+	wl_surface_damage(surface, 0, 0, BUFFER_WIDTH, BUFFER_HEIGHT);
+	frame = wl_surface_frame(surface);
+	wl_callback_add_listener(frame, &frame_listener, &client);
+	wl_surface_commit(surface);
+	assert(wl_display_flush(client.display) >= 0);
+	t = test_now();
+	elapsed[PHASE_COMMIT] = (t - start) / 1e3;
+	start = t;
+
+	while (!client.frame_done)
+		assert(wl_display_dispatch(client.display) >= 0);
+	t = test_now();
+	elapsed[PHASE_FRAME] = (t - start) / 1e3;
+
+	wl_surface_destroy(surface);
+	wl_buffer_destroy(buffer);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+	wl_shm_destroy(client.shm);
+	wl_compositor_destroy(client.compositor);
+	wl_registry_destroy(client.registry);
+	wl_display_disconnect(client.display);
+}
+
+int main(int argc, char *argv[])
+{
+	struct phase_stats stats[PHASE_COUNT];
+	double elapsed[PHASE_COUNT], total;
+	struct wl_display *display;
+	const char *socket_name;
+	char runtime_dir[] = "/tmp/wayland-startup-benchmark-XXXXXX";
+	bool own_runtime_dir = false;
+	pthread_t thread;
+	int iterations = DEFAULT_ITERATIONS;
+	int i, p;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!getenv("XDG_RUNTIME_DIR")) {
+		assert(mkdtemp(runtime_dir));
+		setenv("XDG_RUNTIME_DIR", runtime_dir, 1);
+		own_runtime_dir = true;
+	}
+
+	display = wl_display_create();
+	assert(display);
+	socket_name = wl_display_add_socket_auto(display);
+	assert(socket_name);
+	assert(wl_display_init_shm(display) == 0);
+	assert(wl_global_create(display, &wl_compositor_interface, 4,
+				NULL, bind_compositor));
+
+	assert(pthread_create(&thread, NULL, compositor_thread, display) == 0);
+
+	for (p = 0; p < PHASE_COUNT; p++) {
+		stats[p].min = 1e300;
+		stats[p].max = 0;
+		stats[p].sum = 0;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		run_client(socket_name, elapsed);
+
+		for (p = 0; p < PHASE_COUNT; p++) {
+			if (elapsed[p] < stats[p].min)
+				stats[p].min = elapsed[p];
+			if (elapsed[p] > stats[p].max)
+				stats[p].max = elapsed[p];
+			stats[p].sum += elapsed[p];
+		}
+	}
+
+	wl_display_terminate(display);
+	pthread_join(thread, NULL);
+	wl_display_destroy(display);
+
+	if (own_runtime_dir)
+		rmdir(runtime_dir);
+
+	printf("benchmarked %d cold starts (usec):\n", iterations);
+	printf("%-10s %10s %10s %10s\n", "phase", "min", "avg", "max");
+	total = 0;
+	for (p = 0; p < PHASE_COUNT; p++) {
+		printf("%-10s %10.1f %10.1f %10.1f\n", phase_names[p],
+		       stats[p].min, stats[p].sum / iterations, stats[p].max);
+		total += stats[p].sum;
+	}
+	printf("%-10s %10s %10.1f\n", "total", "", total / iterations);
+
+	return 0;
+}
@@ -141,6 +141,17 @@ test_sleep(unsigned int sec)
 	assert(nanosleep(&ts, NULL) == 0);
 }
 
+/* Monotonic time in nanoseconds, for benchmarks */
+double
+test_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
 /** Try to disable coredumps
  *
  * Useful for tests that crash on purpose, to avoid creating a core file
@@ -86,6 +86,9 @@ test_sleep(unsigned int);
 void
 test_disable_coredumps(void);
 
+double
+test_now(void);
+
 #define DISABLE_LEAK_CHECKS				\
 	do {						\
 		extern int fd_leak_check_enabled;	\